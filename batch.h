@@ -0,0 +1,376 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Batch runner: many independent single runs in one process.
+// A manifest lists one job per line, a trace file and a cache configuration:
+//
+//     <trace_file> <cache size> <block size> <associativity> <replacement policy>
+//
+// (blank lines and lines starting with # are skipped). A fixed pool of worker
+// threads takes the jobs in order; each job has its own trace reader, cache and
+// counters (struct sim_context), so nothing is shared between jobs but the index of
+// the next one. Every job is simulated like a single run without the item view,
+// with the -reader, -sample, -skip, -warmup, -records and write policy options of
+// the command line. When all jobs are done one report is written, JSON if its name
+// ends in .json and CSV otherwise, with one row per job in manifest order.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "trace_reader.h"
+#include "sampling.h"
+#include "opt.h"
+#include "sim_context.h"
+
+#define BATCH_LINE_MAX 4096
+
+struct batch_job {
+	char *trace_file_name;
+	int cache_size;
+	int block_size;
+	int associativity;
+	int replacement_policy;
+
+	const char *error;          // NULL when the job ran
+	unsigned long long records;
+	unsigned long long accesses;
+	unsigned long long read_accesses;
+	unsigned long long write_accesses;
+	double hits;                // estimates when the job is sampled
+	double misses;
+	double misses_with_writeback;
+	double seconds;
+};
+
+struct batch_t {
+	struct batch_job *jobs;
+	int njobs;
+
+	// options shared by every job
+	enum trace_reader_mode mode;
+	int sample_one_in;
+	int write_through;
+	int no_write_allocate;
+	unsigned long long skip_records;
+	unsigned long long warmup_records;
+	unsigned long long region_records;
+
+	pthread_mutex_t lock;
+	int next_job;               // first job no worker has taken
+	int finished;
+	double start;
+};
+
+// Reads the manifest. Returns NULL (after a message) on a bad file.
+struct batch_t * batch_create(char *manifest_file_name)
+{
+	FILE *manifest_fd;
+	char line[BATCH_LINE_MAX], trace_file_name[BATCH_LINE_MAX];
+	int capacity = 64, line_number = 0;
+	struct batch_job job;
+	struct batch_t *B;
+
+	manifest_fd = fopen(manifest_file_name, "r");
+	if (!manifest_fd) {
+		fprintf(stdout, "\nbatch manifest %s not opened.\n", manifest_file_name);
+		return NULL;
+	}
+
+	B = (struct batch_t *)calloc(1, sizeof(struct batch_t));
+	B->jobs = (struct batch_job *)calloc(capacity, sizeof(struct batch_job));
+	B->sample_one_in = 1;
+
+	while (fgets(line, sizeof(line), manifest_fd)) {
+		char *p = line;
+		line_number++;
+
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+		memset(&job, 0, sizeof(job));
+		if (sscanf(p, "%s %d %d %d %d", trace_file_name, &job.cache_size, &job.block_size, &job.associativity, &job.replacement_policy) != 5) {
+			fprintf(stdout, "\n%s:%d: expected <trace file> <cache size> <block size> <associativity> <replacement policy>\n", manifest_file_name, line_number);
+			fclose(manifest_fd);
+			return NULL;
+		}
+
+		//same restrictions as a single run
+		if (job.cache_size <= 0 || job.block_size <= 0 || job.associativity <= 0
+			|| (job.cache_size != (job.cache_size & -job.cache_size))
+			|| (job.block_size != (job.block_size & -job.block_size))
+			|| (job.associativity != (job.associativity & -job.associativity))) {
+			fprintf(stdout, "\n%s:%d: cache size, block size, and block associativity have to be a power of 2.\n", manifest_file_name, line_number);
+			fclose(manifest_fd);
+			return NULL;
+		}
+		if (!(job.replacement_policy >= 0 && job.replacement_policy < CACHE_NPOLICIES)) {
+			fprintf(stdout, "\n%s:%d: pick a replacement policy from 0 to %d.\n", manifest_file_name, line_number, CACHE_NPOLICIES - 1);
+			fclose(manifest_fd);
+			return NULL;
+		}
+		job.trace_file_name = strdup(trace_file_name);
+
+		if (B->njobs == capacity) {
+			capacity = capacity * 2;
+			B->jobs = (struct batch_job *)realloc(B->jobs, capacity * sizeof(struct batch_job));
+		}
+		B->jobs[B->njobs] = job;
+		B->njobs++;
+	}
+	fclose(manifest_fd);
+
+	if (B->njobs == 0) {
+		fprintf(stdout, "\nbatch manifest %s has no jobs.\n", manifest_file_name);
+		return NULL;
+	}
+
+	pthread_mutex_init(&B->lock, NULL);
+	return B;
+}
+
+// Simulates one job start to end on its own context
+void batch_run_job(struct batch_t *B, struct batch_job *J)
+{
+	struct sim_context ctx;
+	struct cache_t *cp;
+	struct opt_t *opt = NULL;
+	struct cache_batch_stats stats = { 0, 0, 0, 0 };
+	struct sampling_estimate e;
+	const struct trace_item *tr_entry;
+	unsigned long addresses[CACHE_BATCH_SIZE];
+	unsigned char types[CACHE_BATCH_SIZE];
+	unsigned long long now = 0, warmup_end;
+	int n = 0, size;
+
+	if (!sim_open(&ctx, J->trace_file_name, B->mode)) {
+		J->error = "trace not opened";
+		return;
+	}
+	if (B->skip_records && sim_skip(&ctx, B->skip_records) < B->skip_records) {
+		J->error = "trace shorter than -skip";
+		sim_close(&ctx);
+		return;
+	}
+	warmup_end = ctx.trace_records + B->warmup_records;
+	if (B->region_records) {
+		ctx.record_limit = warmup_end + B->region_records;
+	}
+
+	cp = cache_create(J->cache_size, J->block_size, J->associativity, (enum cache_policy)J->replacement_policy);
+	if (B->sample_one_in > 1) {
+		cache_set_sampling(cp, B->sample_one_in);
+	}
+	cache_set_write_policy(cp, B->write_through, B->no_write_allocate);
+	if (cp->policy == OPT) {
+		opt = opt_create(cp, J->trace_file_name, B->mode, B->skip_records, ctx.record_limit);
+		if (!opt) {
+			J->error = "OPT pre-pass failed";
+			cache_free(cp);
+			sim_close(&ctx);
+			return;
+		}
+	}
+
+	// warmup: seen by the cache, not counted
+	while (ctx.trace_records < warmup_end && sim_next(&ctx, &tr_entry)) {
+		if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+			now = now + 1;
+			cache_access(cp, tr_entry->Addr, tr_entry->type, NULL, 0, now);
+		}
+	}
+	if (cp->sample_counts) {
+		memset(cp->sample_counts, 0, (size_t)(cp->nsets >> cp->sample_shift) * 3 * sizeof(unsigned long long));
+	}
+
+	// the batch path of a single run
+	while (1) {
+		size = sim_next(&ctx, &tr_entry);
+		if (size && (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE)) {
+			addresses[n] = tr_entry->Addr;
+			types[n] = tr_entry->type;
+			n = n + 1;
+			if (tr_entry->type == ti_LOAD) {
+				ctx.read_accesses = ctx.read_accesses + 1;
+			}
+			else {
+				ctx.write_accesses = ctx.write_accesses + 1;
+			}
+			ctx.accesses = ctx.accesses + 1;
+		}
+		if (n == CACHE_BATCH_SIZE || (!size && n)) {
+			cache_access_batch(cp, addresses, types, n, now + 1, NULL, &stats);
+			now = now + n;
+			n = 0;
+		}
+		if (!size) break;
+	}
+
+	J->records = ctx.trace_records;
+	J->accesses = ctx.accesses;
+	J->read_accesses = ctx.read_accesses;
+	J->write_accesses = ctx.write_accesses;
+	if (cp->sample_counts) {
+		sampling_estimate(cp, ctx.accesses, &e);
+		J->hits = e.value[0];
+		J->misses = e.value[1];
+		J->misses_with_writeback = e.value[2];
+	}
+	else {
+		J->hits = (double)stats.hits;
+		J->misses = (double)stats.misses;
+		J->misses_with_writeback = (double)stats.misses_with_writeback;
+	}
+	J->seconds = progress_seconds() - ctx.progress_start;
+
+	if (opt) {
+		opt_close(opt);
+	}
+	cache_free(cp);
+	sim_close(&ctx);
+}
+
+void * batch_work(void *arg)
+{
+	struct batch_t *B = (struct batch_t *)arg;
+	struct batch_job *J;
+	int k;
+
+	while (1) {
+		pthread_mutex_lock(&B->lock);
+		k = B->next_job;
+		if (k < B->njobs) {
+			B->next_job++;
+		}
+		pthread_mutex_unlock(&B->lock);
+		if (k >= B->njobs) {
+			return NULL;
+		}
+
+		J = &B->jobs[k];
+		batch_run_job(B, J);
+
+		pthread_mutex_lock(&B->lock);
+		B->finished++;
+		fprintf(stderr, "Batch: %d/%d done, %s %dKB %dB %d-way %s: %s\n", B->finished, B->njobs, J->trace_file_name,
+			J->cache_size, J->block_size, J->associativity, cache_policy_names[J->replacement_policy], J->error ? J->error : "ok");
+		pthread_mutex_unlock(&B->lock);
+	}
+}
+
+// Runs every job on nthreads workers (one per CPU when nthreads is 0) and waits for them
+void batch_run(struct batch_t *B, int nthreads)
+{
+	pthread_t *threads;
+	int i;
+
+	if (nthreads <= 0) {
+		nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if (nthreads <= 0) nthreads = 1;
+	}
+	if (nthreads > B->njobs) {
+		nthreads = B->njobs;
+	}
+
+	B->start = progress_seconds();
+	threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		pthread_create(&threads[i], NULL, batch_work, B);
+	}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	printf("\nBatch: %d jobs on %d threads in %.1f s\n", B->njobs, nthreads, progress_seconds() - B->start);
+}
+
+// Writes s as a JSON string
+void batch_json_string(FILE *fd, const char *s)
+{
+	fputc('"', fd);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', fd);
+			fputc(*s, fd);
+		}
+		else if ((unsigned char)*s < 0x20) {
+			fprintf(fd, "\\u%04x", (unsigned char)*s);
+		}
+		else {
+			fputc(*s, fd);
+		}
+	}
+	fputc('"', fd);
+}
+
+// Writes the report of every job. Returns 0 if report_name cannot be created.
+int batch_write_report(struct batch_t *B, char *report_name)
+{
+	size_t len = strlen(report_name);
+	int json = len > 5 && strcmp(report_name + len - 5, ".json") == 0;
+	struct batch_job *J;
+	double miss_rate;
+	FILE *fd;
+	int k;
+
+	fd = fopen(report_name, "w");
+	if (!fd) {
+		return 0;
+	}
+
+	if (json) {
+		fprintf(fd, "[\n");
+	}
+	else {
+		fprintf(fd, "trace,cache_kb,block_bytes,associativity,policy,sample_one_in,records,accesses,read_accesses,write_accesses,hits,misses,writebacks,miss_rate,seconds,status\n");
+	}
+	for (k = 0; k < B->njobs; k++) {
+		J = &B->jobs[k];
+		miss_rate = J->accesses ? (J->misses + J->misses_with_writeback) / (double)J->accesses : 0.0;
+		if (json) {
+			fprintf(fd, "  {\"trace\": ");
+			batch_json_string(fd, J->trace_file_name);
+			fprintf(fd, ", \"cache_kb\": %d, \"block_bytes\": %d, \"associativity\": %d, \"policy\": \"%s\", \"sample_one_in\": %d",
+				J->cache_size, J->block_size, J->associativity, cache_policy_names[J->replacement_policy], B->sample_one_in);
+			fprintf(fd, ", \"records\": %llu, \"accesses\": %llu, \"read_accesses\": %llu, \"write_accesses\": %llu",
+				J->records, J->accesses, J->read_accesses, J->write_accesses);
+			fprintf(fd, ", \"hits\": %.0f, \"misses\": %.0f, \"writebacks\": %.0f, \"miss_rate\": %.6f, \"seconds\": %.3f, \"status\": ",
+				J->hits, J->misses, J->misses_with_writeback, miss_rate, J->seconds);
+			batch_json_string(fd, J->error ? J->error : "ok");
+			fprintf(fd, "}%s\n", k + 1 < B->njobs ? "," : "");
+		}
+		else {
+			// a trace name with a comma or quote is quoted, as CSV readers expect
+			if (strpbrk(J->trace_file_name, ",\"")) {
+				const char *s;
+				fputc('"', fd);
+				for (s = J->trace_file_name; *s; s++) {
+					if (*s == '"') fputc('"', fd);
+					fputc(*s, fd);
+				}
+				fputc('"', fd);
+			}
+			else {
+				fputs(J->trace_file_name, fd);
+			}
+			fprintf(fd, ",%d,%d,%d,%s,%d,%llu,%llu,%llu,%llu,%.0f,%.0f,%.0f,%.6f,%.3f,%s\n",
+				J->cache_size, J->block_size, J->associativity, cache_policy_names[J->replacement_policy], B->sample_one_in,
+				J->records, J->accesses, J->read_accesses, J->write_accesses,
+				J->hits, J->misses, J->misses_with_writeback, miss_rate, J->seconds, J->error ? J->error : "ok");
+		}
+	}
+	if (json) {
+		fprintf(fd, "]\n");
+	}
+	return fclose(fd) == 0;
+}
+
+#endif
@@ -0,0 +1,164 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Simulator throughput benchmark.
+// Generates synthetic traces (trace_gen.h) in memory and times cache_access over a
+// matrix of cache sizes, associativities and replacement policies. One result line
+// per run goes to stdout, as CSV (default) or JSON.
+//
+//     bench [-n <accesses>] [-footprint <KB>] [-stride <bytes>] [-zipf <s>]
+//           [-block <bytes>] [-pattern <name>] [-generic] [-json]
+//     bench -write <trace_file> [-pattern <name>] [-n <accesses>] ...
+//
+// -pattern limits the run to one generator (default: all of them); -generic times the
+// generic code even where a specialized engine exists (see cache_select_engine);
+// -write saves the generated trace as trace_items instead of timing anything.
+//
+// Build: gcc -O2 -pthread -o bench bench.c -lm
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "trace_gen.h"
+
+int bench_sizes[] = { 4, 32, 256, 2048 };   // KB
+int bench_assocs[] = { 1, 4, 8, 16 };
+
+#define BENCH_NSIZES (int)(sizeof(bench_sizes) / sizeof(bench_sizes[0]))
+#define BENCH_NASSOCS (int)(sizeof(bench_assocs) / sizeof(bench_assocs[0]))
+
+double bench_seconds()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+	struct trace_gen_params params;
+	struct trace_item *items;
+	struct cache_t *cp;
+	char *write_name = NULL;
+	size_t n = 1000000, i;
+	int block_size = 64, only_pattern = -1, json = 0, first = 1, generic = 0;
+	int p, s, a, policy, status;
+	unsigned long long counts[3];
+	double start, seconds;
+	FILE *out;
+
+	params.footprint = 4096 * 1024;
+	params.stride = 256;
+	params.zipf_s = 1.0;
+
+	for (i = 1; i < (size_t)argc; i++) {
+		if (strcmp(argv[i], "-json") == 0) {
+			json = 1;
+		}
+		else if (strcmp(argv[i], "-generic") == 0) {
+			generic = 1;
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-n") == 0) {
+			n = (size_t)atoll(argv[++i]);
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-footprint") == 0) {
+			params.footprint = (unsigned int)atoi(argv[++i]) * 1024;
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-stride") == 0) {
+			params.stride = (unsigned int)atoi(argv[++i]);
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-zipf") == 0) {
+			params.zipf_s = atof(argv[++i]);
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-block") == 0) {
+			block_size = atoi(argv[++i]);
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-pattern") == 0) {
+			only_pattern = trace_gen_from_name(argv[++i]);
+			if (only_pattern < 0) {
+				fprintf(stdout, "\nPattern has to be sequential, strided, random, zipf or chase. %s is not valid.\n\n", argv[i]);
+				exit(0);
+			}
+		}
+		else if (i + 1 < (size_t)argc && strcmp(argv[i], "-write") == 0) {
+			write_name = argv[++i];
+		}
+		else {
+			fprintf(stdout, "\nUSAGE: bench [-n <accesses>] [-footprint <KB>] [-stride <bytes>] [-zipf <s>] [-block <bytes>] [-pattern <name>] [-generic] [-json]\n");
+			fprintf(stdout, "       bench -write <trace_file> [-pattern <name>] [-n <accesses>] ...\n\n");
+			exit(0);
+		}
+	}
+	if (n == 0 || params.footprint < TRACE_GEN_BLOCK || params.stride == 0 || block_size <= 0 || block_size != (block_size & -block_size)) {
+		fprintf(stdout, "\nThe access count, footprint and stride have to be positive and the block size a power of 2.\n\n");
+		exit(0);
+	}
+
+	items = (struct trace_item *)malloc(n * sizeof(struct trace_item));
+	if (!items) {
+		fprintf(stdout, "** trace buffer not allocated\n");
+		exit(-1);
+	}
+
+	if (write_name) {
+		trace_gen_fill((enum trace_gen_pattern)(only_pattern < 0 ? TRACE_GEN_SEQUENTIAL : only_pattern), &params, items, n);
+		out = fopen(write_name, "wb");
+		if (!out) {
+			fprintf(stdout, "\noutput file %s not opened.\n\n", write_name);
+			exit(0);
+		}
+		fwrite(items, sizeof(struct trace_item), n, out);
+		fclose(out);
+		free(items);
+		exit(0);
+	}
+
+	if (json) printf("[\n");
+	else printf("pattern,footprint_kb,cache_kb,block,assoc,policy,accesses,seconds,accesses_per_sec,ns_per_access,hit_ratio\n");
+
+	for (p = 0; p < TRACE_GEN_NPATTERNS; p++) {
+		if (only_pattern >= 0 && p != only_pattern) continue;
+		trace_gen_fill((enum trace_gen_pattern)p, &params, items, n);
+
+		for (s = 0; s < BENCH_NSIZES; s++) {
+			for (a = 0; a < BENCH_NASSOCS; a++) {
+				for (policy = 0; policy < CACHE_NPOLICIES_ONLINE; policy++) {
+					cp = cache_create(bench_sizes[s], block_size, bench_assocs[a], (enum cache_policy)policy);
+					if (generic) cp->engine = NULL;
+					counts[0] = counts[1] = counts[2] = 0;
+
+					start = bench_seconds();
+					for (i = 0; i < n; i++) {
+						status = cache_access(cp, items[i].Addr, items[i].type, NULL, 0, i + 1);
+						counts[status]++;
+					}
+					seconds = bench_seconds() - start;
+
+					if (json) {
+						printf("%s  {\"pattern\": \"%s\", \"footprint_kb\": %u, \"cache_kb\": %d, \"block\": %d, \"assoc\": %d, \"policy\": \"%s\", "
+							"\"accesses\": %zu, \"seconds\": %.6f, \"accesses_per_sec\": %.0f, \"ns_per_access\": %.3f, \"hit_ratio\": %.6f}",
+							first ? "" : ",\n", trace_gen_names[p], params.footprint / 1024, bench_sizes[s], block_size, bench_assocs[a],
+							cache_policy_names[policy], n, seconds, (double)n / seconds, seconds * 1e9 / (double)n, (double)counts[0] / (double)n);
+					}
+					else {
+						printf("%s,%u,%d,%d,%d,%s,%zu,%.6f,%.0f,%.3f,%.6f\n", trace_gen_names[p], params.footprint / 1024, bench_sizes[s], block_size,
+							bench_assocs[a], cache_policy_names[policy], n, seconds, (double)n / seconds, seconds * 1e9 / (double)n, (double)counts[0] / (double)n);
+					}
+					fflush(stdout);
+					first = 0;
+
+					cache_free(cp);
+				}
+			}
+		}
+	}
+
+	if (json) printf("\n]\n");
+	free(items);
+	exit(0);
+}
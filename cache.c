@@ -1,89 +1,297 @@
+#define _FILE_OFFSET_BITS 64 //traces larger than 2 GB on 32-bit hosts
+#define _GNU_SOURCE //fopencookie, for compressed traces
 #include <stdio.h>
+#include <string.h>
 #include "trace_item.h"
 #include "skeleton.h"
+#include "sweep.h"
+#include "mattson.h"
+#include "trace_reader.h"
+#include "hierarchy.h"
+#include "event_log.h"
+#include "sampling.h"
+#include "parallel.h"
+#include "coherence.h"
+#include "threec.h"
+#include "prefetch.h"
+#include "writebuf.h"
+#include "timing.h"
+#include "checkpoint.h"
+#include "opt.h"
+#include "miss_stream.h"
+#include "tlb.h"
+#include "sim_context.h"
+#include "batch.h"
 
-#define TRACE_BUFSIZE 1024*1024
-
-static FILE *trace_fd;
-static int trace_buf_ptr;
-static int trace_buf_end;
-static struct trace_item *trace_buf;
-
-// to keep statistics
-unsigned int accesses = 0;
-unsigned int read_accesses = 0;
-unsigned int write_accesses = 0;
-unsigned int hits = 0;
-unsigned int misses = 0;
-unsigned int misses_with_writeback = 0; 
-
-void trace_init()
-{
-    trace_buf = malloc(sizeof(struct trace_item) * TRACE_BUFSIZE);
-    
-    if (!trace_buf) {
-        fprintf(stdout, "** trace_buf not allocatedn");
-        exit(-1);
-    }
-    
-    trace_buf_ptr = 0;
-    trace_buf_end = 0;
-}
-
-void trace_uninit()
-{
-    free(trace_buf);
-    fclose(trace_fd);
-}
-
-int trace_get_item(struct trace_item **item)
-{
-    int n_items;
-    
-    if (trace_buf_ptr == trace_buf_end) {
-        // get new data
-        n_items = fread(trace_buf, sizeof(struct trace_item), TRACE_BUFSIZE, trace_fd);
-        if (!n_items) return 0;
-        
-        trace_buf_ptr = 0;
-        trace_buf_end = n_items;
-    }
-    
-    *item = &trace_buf[trace_buf_ptr];
-    trace_buf_ptr++;
-    
-    return 1;
-}
+static enum trace_reader_mode trace_mode = TRACE_READER_MMAP;
 
 int main(int argc, char **argv)
 {
-    struct trace_item *tr_entry;
+    const struct trace_item *tr_entry;
     size_t size;
     char *trace_file_name;
     int trace_view_on, cache_size, block_size;
     int associativity, replacement_policy;
 	enum cache_policy policy;
 	struct cache_t *cp;
-	struct timeval gettimeofdayreturnstruct;
-	unsigned long long timestamp_in_microsec;
+	unsigned long long now = 0; //logical clock for the replacement state, one tick per access
 	int cache_access_status;
+	unsigned long batch_addresses[CACHE_BATCH_SIZE]; //loads and stores waiting to be simulated
+	unsigned char batch_types[CACHE_BATCH_SIZE];
+	int batch_n = 0;
+	struct cache_batch_stats batch_stats = { 0, 0, 0, 0 };
+	char *event_log_name = NULL; //binary per-access log replacing the trace view
+	struct event_log_t *event_log = NULL;
+	int sample_one_in = 1; //simulate one set in this many, 1 for every set
+	int nthreads = 0; //worker threads: for a single configuration each owns a range of sets, for a batch each runs jobs (0 when not given)
+	struct parallel_t *parallel = NULL;
+	struct coherence_t *coherence = NULL; //set when simulating private caches of several cores
+	int classify_misses = 0; //3C classification of every miss
+	struct threec_t *threec = NULL;
+	int batch_status[CACHE_BATCH_SIZE];
+	int miss_class = -1;
+	char *prefetch_spec = NULL; //prefetcher model, see prefetch.h
+	struct prefetch_t *prefetch = NULL;
+	int write_through = 0, no_write_allocate = 0; //write-back with write-allocate by default
+	int write_buffer_entries = -1, write_buffer_drain = 0; //-1 when memory traffic is not reported
+	struct writebuf_t *writebuf = NULL;
+	int hit_latency = 0, memory_latency = 0, nmshrs = 0; //0 MSHRs when the run is not timed
+	struct timing_t *timing = NULL;
+	unsigned long long skip_records = 0, warmup_records = 0, region_records = 0; //fast-forward, warmup and region of interest
+	unsigned long long warmup_end;
+	char *save_name = NULL, *restore_name = NULL; //checkpoint files, see checkpoint.h
+	struct checkpoint_stats checkpoint;
+	struct opt_t *opt = NULL; //next-use array of an OPT run
+	char *miss_stream_name = NULL; //trace of the misses and writebacks, see miss_stream.h
+	struct miss_stream_t *miss_stream = NULL;
+	unsigned long long progress_interval = 0; //records between progress lines, 0 for none
+	char *tlb_spec = NULL; //TLBs and page size, see tlb.h
+	struct tlb_t *tlb = NULL;
+	struct sim_context run; //trace position and counters of this simulation
 	FILE *file_results; //we will be writing our results out to a file
+	char *results_name = "./results.txt";
+	struct batch_t *batch = NULL; //set when running the jobs of a manifest
+	struct sweep_t *sweep = NULL; //set when simulating several configurations in one pass
+	struct mattson_t *mattson = NULL; //set when computing the LRU miss-ratio curve
+	struct hierarchy_t *hierarchy = NULL; //set when simulating a multi-level hierarchy
+	char *single_option = NULL; //an option of a single run given with one of those
+	int i, j;
 	
 	//define default
 	trace_view_on = 1;
 	cache_size = 1; //1 KB
 	block_size = 4; //4 bytes = 1 word
 	associativity = 1; //1-way associativity
-	replacement_policy = 0; //0 for LRU, 1 for FIFO
+	replacement_policy = 0; //0 LRU, 1 FIFO, 2 tree PLRU, 3 bit PLRU, 4 SRRIP, 5 BRRIP, 6 random, 7 OPT
+	
+	// options that apply to every mode are taken out of argv before the positional arguments are read
+	for (i = 1, j = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-reader") == 0 && i + 1 < argc) {
+			if (trace_reader_mode_from_name(argv[i + 1]) < 0) {
+				fprintf(stdout, "\nTrace reader has to be fread, mmap or thread. %s is not valid.", argv[i + 1]);
+				exit(0);
+			}
+			trace_mode = (enum trace_reader_mode)trace_reader_mode_from_name(argv[i + 1]);
+			i++;
+		}
+		else if (strcmp(argv[i], "-eventlog") == 0 && i + 1 < argc) {
+			event_log_name = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-sample") == 0 && i + 1 < argc) {
+			sample_one_in = atoi(argv[i + 1]);
+			if (sample_one_in <= 0 || (sample_one_in != (sample_one_in & -sample_one_in))) {
+				fprintf(stdout, "\nThe set sampling ratio has to be a power of 2. %s is not valid.", argv[i + 1]);
+				exit(0);
+			}
+			i++;
+		}
+		else if (strcmp(argv[i], "-prefetch") == 0 && i + 1 < argc) {
+			prefetch_spec = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-progress") == 0 && i + 1 < argc) {
+			if (atoi(argv[i + 1]) <= 0) {
+				fprintf(stdout, "\nThe progress interval has to be at least 1 million records. %s is not valid.", argv[i + 1]);
+				exit(0);
+			}
+			progress_interval = (unsigned long long)atoi(argv[i + 1]) * 1000000ULL;
+			i++;
+		}
+		else if (strcmp(argv[i], "-writethrough") == 0) {
+			write_through = 1;
+		}
+		else if (strcmp(argv[i], "-nowriteallocate") == 0) {
+			no_write_allocate = 1;
+		}
+		else if (strcmp(argv[i], "-writebuffer") == 0 && i + 1 < argc) {
+			write_buffer_drain = 0;
+			if (sscanf(argv[i + 1], "%d:%d", &write_buffer_entries, &write_buffer_drain) < 1 || write_buffer_entries < 0 || write_buffer_drain < 0) {
+				fprintf(stdout, "\nThe write buffer has to be <entries>[:<accesses between drains>]. %s is not valid.", argv[i + 1]);
+				exit(0);
+			}
+			i++;
+		}
+		else if (strcmp(argv[i], "-timing") == 0 && i + 1 < argc) {
+			nmshrs = 8;
+			if (sscanf(argv[i + 1], "%d:%d:%d", &hit_latency, &memory_latency, &nmshrs) < 2 || hit_latency < 0 || memory_latency < 0 || nmshrs <= 0) {
+				fprintf(stdout, "\nTiming has to be <hit latency>:<memory latency>[:<MSHRs>]. %s is not valid.", argv[i + 1]);
+				exit(0);
+			}
+			i++;
+		}
+		else if ((strcmp(argv[i], "-skip") == 0 || strcmp(argv[i], "-warmup") == 0 || strcmp(argv[i], "-records") == 0) && i + 1 < argc) {
+			if (sscanf(argv[i + 1], "%llu", argv[i][1] == 's' ? &skip_records : argv[i][1] == 'w' ? &warmup_records : &region_records) != 1) {
+				fprintf(stdout, "\n%s takes a number of trace records. %s is not valid.", argv[i], argv[i + 1]);
+				exit(0);
+			}
+			i++;
+		}
+		else if (strcmp(argv[i], "-tlb") == 0 && i + 1 < argc) {
+			tlb_spec = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-missout") == 0 && i + 1 < argc) {
+			miss_stream_name = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-save") == 0 && i + 1 < argc) {
+			save_name = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-restore") == 0 && i + 1 < argc) {
+			restore_name = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-results") == 0 && i + 1 < argc) {
+			results_name = argv[i + 1];
+			i++;
+		}
+		else if (strcmp(argv[i], "-3c") == 0) {
+			classify_misses = 1;
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			nthreads = atoi(argv[i + 1]);
+			if (nthreads <= 0) {
+				fprintf(stdout, "\nThe number of threads has to be at least 1. %s is not valid.", argv[i + 1]);
+				exit(0);
+			}
+			i++;
+		}
+		else {
+			argv[j] = argv[i];
+			j++;
+		}
+	}
+	argc = j;
 	
     if (argc == 1) {
         fprintf(stdout, "nUSAGE: tv <trace_file> <switch - any character>n");
         fprintf(stdout, "n(switch) to turn on or off individual item view.nn");
+        fprintf(stdout, "\nSWEEP: tv <trace_file> -sweep <config_file>\n");
+        fprintf(stdout, "\n(config_file) one <cache size> <block size> <associativity> <policy> per line.\n");
+        fprintf(stdout, "\nLRU CURVE: tv <trace_file> -mattson <block size> <max cache size>\n");
+        fprintf(stdout, "\nHIERARCHY: tv <trace_file> -hierarchy <config_file>\n");
+        fprintf(stdout, "\n(config_file) <L1I|L1D|L1|L2|...> <size> <block size> <associativity> <policy> [<latency>] per level, optional inclusion nine|inclusive|exclusive and memory <latency> [<MSHRs>].\n");
+        fprintf(stdout, "\nCOHERENCE: tv -coherence <config_file>\n");
+        fprintf(stdout, "\n(config_file) protocol mesi|moesi, schedule rr|random <quantum>, cache <size> <block size> <associativity> <policy>, one core <trace_file> per core.\n");
+        fprintf(stdout, "\nBATCH: tv -batch <manifest> <report.csv|report.json>\n");
+        fprintf(stdout, "\n(manifest) one <trace_file> <cache size> <block size> <associativity> <policy> per line, run as single runs on -threads workers (one per CPU by default).\n");
+        fprintf(stdout, "\nOPTIONS: -reader fread|mmap|thread (default mmap)\n");
+        fprintf(stdout, "         -eventlog <log_file> binary per-access log of a single run instead of the item view (see event_dump)\n");
+        fprintf(stdout, "         -sample <K> simulate one set in K and estimate the totals (single run and sweep)\n");
+        fprintf(stdout, "         -threads <N> split the sets of a single run over N threads (not with random or BRRIP), or run N batch jobs at a time\n");
+        fprintf(stdout, "         -3c classify the misses of a single run as compulsory, capacity or conflict\n");
+        fprintf(stdout, "         -prefetch nextline[:N]|stride[:N]|stream[:S[:D]] add a prefetcher to a single run\n");
+        fprintf(stdout, "         -progress <N> print records read and throughput every N million records (on stderr)\n");
+        fprintf(stdout, "         -writethrough, -nowriteallocate, -writebuffer <N>[:<D>] write policy of a single run, with memory traffic\n");
+        fprintf(stdout, "         -timing <hit>:<memory>[:<MSHRs>] cycle-approximate AMAT and total cycles of a single run without -prefetch (8 MSHRs by default)\n");
+        fprintf(stdout, "         -skip <N> read past the first N records without simulating them\n");
+        fprintf(stdout, "         -warmup <M> then simulate M records without counting them (single run and sweep)\n");
+        fprintf(stdout, "         -records <R> then simulate only the next R records\n");
+        fprintf(stdout, "         -save <file>, -restore <file> write the cache and counters of a single run at its end, or start from them\n");
+        fprintf(stdout, "         -missout <file> write the fills, writebacks and memory stores of a single run as a trace (.mtr for the compact format)\n");
+        fprintf(stdout, "         -results <file> write the results there instead of ./results.txt\n");
+        fprintf(stdout, "         -tlb <entries>:<ways>[,<L2 entries>:<L2 ways>][,4k|2m|1g] translate the addresses of a single run, walking the page table through the cache\n\n");
         exit(0);
     }
  		
+	// coherence mode: one trace per core, each core with its own cache, kept coherent over a snooping bus
+	if (argc == 3 && strcmp(argv[1], "-coherence") == 0) {
+		coherence = coherence_create(argv[2], trace_mode);
+		if (!coherence) {
+			exit(0);
+		}
+		coherence_run(coherence);
+		
+		file_results = fopen(results_name, "w");
+		coherence_print_results(coherence, file_results);
+		fclose(file_results);
+		coherence_close(coherence);
+		exit(0);
+	}
+	
+	// batch mode: every job of the manifest is a single run of its own, the jobs run side by side
+	if (argc == 4 && strcmp(argv[1], "-batch") == 0) {
+		// jobs run the batch path of a single run, which has none of the per-access models
+		if (prefetch_spec || tlb_spec || classify_misses || write_buffer_entries >= 0 || nmshrs || miss_stream_name
+			|| save_name || restore_name || event_log_name || progress_interval || strcmp(results_name, "./results.txt") != 0) {
+			fprintf(stdout, "\n-batch cannot be combined with -prefetch, -tlb, -3c, -writebuffer, -timing, -missout, -save, -restore, -eventlog, -progress or -results.\n");
+			exit(0);
+		}
+		batch = batch_create(argv[2]);
+		if (!batch) {
+			exit(0);
+		}
+		batch->mode = trace_mode;
+		batch->sample_one_in = sample_one_in;
+		batch->write_through = write_through;
+		batch->no_write_allocate = no_write_allocate;
+		batch->skip_records = skip_records;
+		batch->warmup_records = warmup_records;
+		batch->region_records = region_records;
+		batch_run(batch, nthreads);
+		
+		if (!batch_write_report(batch, argv[3])) {
+			fprintf(stdout, "\nbatch report %s not written.\n", argv[3]);
+			exit(0);
+		}
+		printf("Report: %s\n", argv[3]);
+		exit(0);
+	}
+	
 	trace_file_name = argv[1]; 	
     
+	// sweep mode: every configuration listed in the file is simulated in a single pass over the trace
+	if (argc == 4 && strcmp(argv[2], "-sweep") == 0) {
+		sweep = sweep_create(argv[3]);
+		if (!sweep) {
+			exit(0);
+		}
+		if (sample_one_in > 1) {
+			sweep_set_sampling(sweep, sample_one_in);
+		}
+	}
+	
+	// stack-distance mode: LRU misses of every cache size and associativity up to the maximum in one pass
+	if (argc == 5 && strcmp(argv[2], "-mattson") == 0) {
+		block_size = atoi(argv[3]);
+		cache_size = atoi(argv[4]);
+		if (block_size <= 0 || cache_size <= 0 || (cache_size != (cache_size & -cache_size)) || (block_size != (block_size & -block_size))) {
+			fprintf(stdout, "Cache size and block size have to be a power of 2. (For example: 1, 2, 4, 8, 16, ...");
+			exit(0);
+		}
+		mattson = mattson_create(block_size, cache_size);
+	}
+	
+	// hierarchy mode: split or unified L1 and lower levels, each with its own statistics
+	if (argc == 4 && strcmp(argv[2], "-hierarchy") == 0) {
+		hierarchy = hierarchy_create(argv[3]);
+		if (!hierarchy) {
+			exit(0);
+		}
+	}
+    
 	// here you should extract the cache parameters from the command line
 	if (argc == 7)
 	{
@@ -97,32 +305,106 @@ int main(int argc, char **argv)
 			exit(0);		
 		}
 		replacement_policy = atoi(argv[6]);
-		if ( !(replacement_policy == 0 || replacement_policy == 1) ){
-			fprintf(stdout, "\nMake sure that you pick either 0 for LRU replacement or 1 for FIFO replacement.");
+		if ( !(replacement_policy >= 0 && replacement_policy < CACHE_NPOLICIES) ){
+			fprintf(stdout, "\nMake sure that you pick 0 for LRU, 1 for FIFO, 2 for tree PLRU, 3 for bit PLRU, 4 for SRRIP, 5 for BRRIP, 6 for random or 7 for OPT replacement.");
 			fprintf(stdout, " %d is not a valid number.", replacement_policy);
 			exit(0);
 		}
 	}
     	
-    if(replacement_policy){
-        policy = FIFO;
-    }
-    else{
-        policy = LRU;
-    }
+    policy = (enum cache_policy)replacement_policy;
 	
     fprintf(stdout, "n ** opening file %sn", trace_file_name);
     
-    trace_fd = fopen(trace_file_name, "rb");
-    
-    if (!trace_fd) {
+    if (!sim_open(&run, trace_file_name, trace_mode)) {
         fprintf(stdout, "ntrace file %s not opened.nn", trace_file_name);
         exit(0);
     }
+	run.progress_interval = progress_interval;
+	
+	// fast-forward at decode speed, then bound the region being simulated
+	if (skip_records && sim_skip(&run, skip_records) < skip_records) {
+		fprintf(stdout, "\nThe trace has fewer than %llu records to skip.\n", skip_records);
+		exit(0);
+	}
+	warmup_end = run.trace_records + warmup_records;
+	if (region_records) {
+		run.record_limit = warmup_end + region_records;
+	}
+	// the per-access models hang off the cache of a single run, the other modes would ignore them
+	if (sweep || mattson || hierarchy) {
+		if (event_log_name) single_option = "-eventlog";
+		if (classify_misses) single_option = "-3c";
+		if (prefetch_spec) single_option = "-prefetch";
+		if (write_through) single_option = "-writethrough";
+		if (no_write_allocate) single_option = "-nowriteallocate";
+		if (write_buffer_entries >= 0) single_option = "-writebuffer";
+		if (nmshrs) single_option = "-timing";
+		if (save_name) single_option = "-save";
+		if (restore_name) single_option = "-restore";
+		if (miss_stream_name) single_option = "-missout";
+		if (tlb_spec) single_option = "-tlb";
+		if (single_option) {
+			fprintf(stdout, "\n%s applies to a single run.\n", single_option);
+			exit(0);
+		}
+	}
+	if (warmup_records && (mattson || hierarchy)) {
+		fprintf(stdout, "\n-warmup applies to a single run or a sweep.\n");
+		exit(0);
+	}
+	if (nthreads && (sweep || mattson || hierarchy)) {
+		fprintf(stdout, "\n-threads applies to a single run or a batch.\n");
+		exit(0);
+	}
+	if (sample_one_in > 1 && (mattson || hierarchy)) {
+		fprintf(stdout, "\n-sample applies to a single run or a sweep.\n");
+		exit(0);
+	}
+	
+	file_results = fopen(results_name, "w"); //open text file for writing out results
     
-    trace_init();
+	if (sweep) {
+		// warm every configuration, then count from a clean slate
+		while (run.trace_records < warmup_end && sim_next(&run, &tr_entry)) {
+			sweep_access(sweep, tr_entry);
+		}
+		sweep_clear_stats(sweep);
+		
+		// decode each item once and hand it to every configuration
+		while (sim_next(&run, &tr_entry)) {
+			sweep_access(sweep, tr_entry);
+		}
+		sweep_print_results(sweep, trace_file_name, file_results);
+		
+		fclose(file_results);
+		sim_close(&run);
+		exit(0);
+	}
 	
-	file_results = fopen("./results.txt", "w"); //open text file for writing out results
+	if (mattson) {
+		while (sim_next(&run, &tr_entry)) {
+			if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+				mattson_access(mattson, tr_entry->Addr);
+			}
+		}
+		mattson_print_results(mattson, trace_file_name, file_results);
+		
+		fclose(file_results);
+		sim_close(&run);
+		exit(0);
+	}
+	
+	if (hierarchy) {
+		while (sim_next(&run, &tr_entry)) {
+			hierarchy_trace_item(hierarchy, tr_entry);
+		}
+		hierarchy_print_results(hierarchy, trace_file_name, file_results);
+		
+		fclose(file_results);
+		sim_close(&run);
+		exit(0);
+	}
     
 	//print back all the parameters
 	printf("Parameters:");
@@ -135,49 +417,324 @@ int main(int argc, char **argv)
 	fprintf(file_results, "\nBlock Size: %d BYTES", block_size);
 	printf("\nAssociativity: %d", associativity);
 	fprintf(file_results, "\nAssociativity: %d", associativity);
-	if (replacement_policy == 0) {
-		printf("\nReplacement Policy: LRU");
-		fprintf(file_results, "\nReplacement Policy: LRU");
+	printf("\nReplacement Policy: %s", cache_policy_names[policy]);
+	fprintf(file_results, "\nReplacement Policy: %s", cache_policy_names[policy]);
+	
+    // here should call cache_create(cache_size, block_size, associativity, replacement_policy)
+	if (restore_name) {
+		// the blocks, replacement state, sampling, write policy and counters all come from the checkpoint
+		cp = checkpoint_load(restore_name, &checkpoint);
+		if (!cp) {
+			exit(0);
+		}
+		if (cp->nsets * cp->assoc * cp->bsize != cache_size * 1024 || cp->bsize != block_size || cp->assoc != associativity || cp->policy != policy) {
+			fprintf(stdout, "\ncheckpoint %s is a %d KB, %d BYTES blocks, %d-way %s cache.\n", restore_name, cp->nsets * cp->assoc * cp->bsize / 1024, cp->bsize, cp->assoc, cache_policy_names[cp->policy]);
+			exit(0);
+		}
+		if (sample_one_in > 1 || write_through || no_write_allocate) {
+			fprintf(stdout, "\nSet sampling and the write policy are taken from checkpoint %s.\n", restore_name);
+			exit(0);
+		}
+		now = checkpoint.now;
+		run.accesses = checkpoint.accesses;
+		run.read_accesses = checkpoint.read_accesses;
+		run.write_accesses = checkpoint.write_accesses;
+		run.hits = checkpoint.hits;
+		run.misses = checkpoint.misses;
+		run.misses_with_writeback = checkpoint.misses_with_writeback;
+		batch_stats.hits = run.hits;
+		batch_stats.misses = run.misses;
+		batch_stats.misses_with_writeback = run.misses_with_writeback;
+		printf("\nRestored: %s, saved after %llu records", restore_name, checkpoint.records);
+		fprintf(file_results, "\nRestored: %s, saved after %llu records", restore_name, checkpoint.records);
 	}
 	else {
-		printf("\nReplacement Policy: FIFO");
-		fprintf(file_results, "\nReplacement Policy: FIFO");
+		cp = cache_create(cache_size, block_size, associativity, policy);
+		if (sample_one_in > 1) {
+			cache_set_sampling(cp, sample_one_in);
+		}
+		cache_set_write_policy(cp, write_through, no_write_allocate);
+	}
+	if (policy == OPT) {
+		// OPT needs the whole future of the run: read the trace once ahead of it
+		if (restore_name || prefetch_spec || tlb_spec) {
+			fprintf(stdout, "\nOPT cannot be combined with -restore, -prefetch or -tlb.\n");
+			exit(0);
+		}
+		opt = opt_create(cp, trace_file_name, trace_mode, skip_records, run.record_limit);
+		if (!opt) {
+			exit(0);
+		}
+		opt_print_results(opt, file_results);
+	}
+	if (classify_misses) {
+		threec = threec_create(cp);
+	}
+	if (cp->write_through || cp->no_write_allocate || write_buffer_entries >= 0) {
+		writebuf = writebuf_create(cp, write_buffer_entries > 0 ? write_buffer_entries : 0, write_buffer_drain);
+	}
+	if (prefetch_spec) {
+		prefetch = prefetch_create(cp, prefetch_spec);
+		if (!prefetch) {
+			fprintf(stdout, "\nPrefetcher has to be nextline[:N], stride[:N] or stream[:S[:D]]. %s is not valid.", prefetch_spec);
+			exit(0);
+		}
+	}
+	if (nmshrs) {
+		// prefetch fills would reach the cache without taking an MSHR or waiting for memory
+		if (prefetch) {
+			fprintf(stdout, "\n-timing cannot be combined with -prefetch.\n");
+			exit(0);
+		}
+		timing = timing_create(nmshrs, cp->n_bits_for_block_offset);
+	}
+	if (tlb_spec) {
+		tlb = tlb_create(cp, tlb_spec);
+		if (!tlb) {
+			fprintf(stdout, "\nTLBs have to be <entries>:<ways>[,<entries>:<ways>][,4k|2m|1g] with a power of 2 sets. %s is not valid.", tlb_spec);
+			exit(0);
+		}
+	}
+	if (miss_stream_name) {
+		// the stream has to hold every miss, and prefetch fills would be missing from it
+		if (cp->sample_counts || prefetch || tlb_spec) {
+			fprintf(stdout, "\n-missout cannot be combined with -sample, -prefetch or -tlb.\n");
+			exit(0);
+		}
+		miss_stream = miss_stream_open(cp, miss_stream_name);
+		if (!miss_stream) {
+			fprintf(stdout, "\nmiss stream %s not opened.\n\n", miss_stream_name);
+			exit(0);
+		}
 	}
 	
-    // here should call cache_create(cache_size, block_size, associativity, replacement_policy)
-    cp = cache_create(cache_size, block_size, associativity, policy);
+	// warmup: the cache (and the 3C shadow cache and TLBs) see these records but nothing is counted
+	if (warmup_records) {
+		while (run.trace_records < warmup_end && sim_next(&run, &tr_entry)) {
+			if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+				if (tlb) {
+					tlb_access(tlb, tr_entry->Addr, &now);
+				}
+				now = now + 1;
+				cache_access_status = cache_access(cp, tr_entry->Addr, tr_entry->type, NULL, 0, now);
+				if (threec) {
+					threec_access(threec, tr_entry->Addr, cache_access_status);
+				}
+			}
+		}
+		if (threec) {
+			threec_clear_stats(threec);
+		}
+		if (tlb) {
+			tlb_clear_stats(tlb);
+		}
+		if (cp->sample_counts) {
+			memset(cp->sample_counts, 0, (size_t)(cp->nsets >> cp->sample_shift) * 3 * sizeof(unsigned long long));
+		}
+	}
+	// prefetch fills and page walks move blocks to and from memory too, from here on
+	if (writebuf) {
+		if (prefetch) {
+			prefetch->writebuf = writebuf;
+		}
+		if (tlb) {
+			tlb->writebuf = writebuf;
+		}
+	}
 	   
+	if (event_log_name) {
+		event_log = event_log_open(event_log_name);
+		if (!event_log) {
+			fprintf(stdout, "\nevent log %s not opened.\n\n", event_log_name);
+			exit(0);
+		}
+	}
+	
+	if (event_log) {
+		// every access goes to the binary event log; the loop below then only sees the end of the trace
+		while (sim_next(&run, &tr_entry)) {
+			if (timing) {
+				timing_tick(timing);
+			}
+			if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+				if (tlb) {
+					tlb_access(tlb, tr_entry->Addr, &now);
+				}
+				now = now + 1;
+				cache_access_status = cache_access(cp, tr_entry->Addr, tr_entry->type, NULL, 0, now);
+				if (timing && cache_access_status != CACHE_NOT_SAMPLED) {
+					timing_access(timing, tr_entry->Addr, cache_access_status != 0, cache_access_status == 0 ? hit_latency : hit_latency + memory_latency);
+				}
+				if (threec) {
+					threec_access(threec, tr_entry->Addr, cache_access_status);
+				}
+				if (writebuf) {
+					writebuf_access(writebuf, tr_entry->Addr, tr_entry->type, cache_access_status);
+				}
+				if (miss_stream) {
+					miss_stream_access(miss_stream, tr_entry, cache_access_status);
+				}
+				if (cache_access_status != CACHE_NOT_SAMPLED) {
+					event_log_record(event_log, cp, tr_entry->Addr, tr_entry->type, cache_access_status);
+				}
+				if (prefetch) {
+					prefetch_access(prefetch, tr_entry->Addr, tr_entry->PC, cache_access_status, now);
+				}
+				if (tr_entry->type == ti_LOAD) {
+					run.read_accesses = run.read_accesses + 1;
+				}
+				else {
+					run.write_accesses = run.write_accesses + 1;
+				}
+				run.accesses = run.accesses + 1;
+				if (cache_access_status == 0) {
+					run.hits = run.hits + 1;
+				}
+				else if (cache_access_status == 1) {
+					run.misses = run.misses + 1;
+				}
+				else if (cache_access_status == 2) {
+					run.misses_with_writeback = run.misses_with_writeback + 1;
+				}
+			}
+		}
+		event_log_close(event_log);
+	}
+	else if (!trace_view_on && nthreads > 1 && parallel_supported(cp) && !threec && !prefetch && !writebuf && !timing && !save_name && !miss_stream && !tlb) {
+		// the sets are divided among worker threads; this thread only decodes and distributes
+		parallel = parallel_create(cp, nthreads);
+		parallel->clock = now; //a restored or warmed cache carries on from its own clock
+		while (sim_next(&run, &tr_entry)) {
+			if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+				parallel_access(parallel, tr_entry->Addr, tr_entry->type);
+				if (tr_entry->type == ti_LOAD) {
+					run.read_accesses = run.read_accesses + 1;
+				}
+				else {
+					run.write_accesses = run.write_accesses + 1;
+				}
+				run.accesses = run.accesses + 1;
+			}
+		}
+		parallel_finish(parallel, &batch_stats);
+		run.hits = batch_stats.hits;
+		run.misses = batch_stats.misses;
+		run.misses_with_writeback = batch_stats.misses_with_writeback;
+	}
+	else if (!trace_view_on && !prefetch && !writebuf && !timing && !miss_stream && !tlb) {
+		// without the per-access view, loads and stores are simulated in batches;
+		// the loop below then only sees the end of the trace and prints the results
+		while (1) {
+			size = sim_next(&run, &tr_entry);
+			if (size && (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE)) {
+				batch_addresses[batch_n] = tr_entry->Addr;
+				batch_types[batch_n] = tr_entry->type;
+				batch_n = batch_n + 1;
+				if (tr_entry->type == ti_LOAD) {
+					run.read_accesses = run.read_accesses + 1;
+				}
+				else {
+					run.write_accesses = run.write_accesses + 1;
+				}
+				run.accesses = run.accesses + 1;
+			}
+			if (batch_n == CACHE_BATCH_SIZE || (!size && batch_n)) {
+				cache_access_batch(cp, batch_addresses, batch_types, batch_n, now + 1, threec ? batch_status : NULL, &batch_stats);
+				if (threec) {
+					for (i = 0; i < batch_n; i++) {
+						threec_access(threec, batch_addresses[i], batch_status[i]);
+					}
+				}
+				now = now + batch_n;
+				batch_n = 0;
+			}
+			if (!size) break;
+		}
+		run.hits = batch_stats.hits;
+		run.misses = batch_stats.misses;
+		run.misses_with_writeback = batch_stats.misses_with_writeback;
+	}
+	
 	while(1) {
-        size = trace_get_item(&tr_entry);        
+        size = sim_next(&run, &tr_entry);        
         if (!size) {       /* no more instructions to simulate */
 			printf("\n\nResults:");
 			fprintf(file_results, "\n\nResults:");
-			printf("\nCache Accesses: %d", accesses);
-			fprintf(file_results, "\nCache Accesses: %d", accesses);
-			printf("\nCache Read Accesses: %d", read_accesses);
-			fprintf(file_results, "\nCache Read Accesses: %d", read_accesses);
-			printf("\nCache Write Accesses: %d", write_accesses);
-			fprintf(file_results, "\nCache Write Accesses: %d", write_accesses);
-			printf("\nCache Hits: %d", hits);
-			fprintf(file_results, "\nCache Hits: %d", hits);
-			printf("\nCache Misses: %d", misses);
-			fprintf(file_results, "\nCache Misses: %d", misses);
-			printf("\nCache Writebacks: %d", misses_with_writeback);
-			fprintf(file_results, "\nCache Writebacks: %d", misses_with_writeback);
+			printf("\nCache Accesses: %llu", run.accesses);
+			fprintf(file_results, "\nCache Accesses: %llu", run.accesses);
+			printf("\nCache Read Accesses: %llu", run.read_accesses);
+			fprintf(file_results, "\nCache Read Accesses: %llu", run.read_accesses);
+			printf("\nCache Write Accesses: %llu", run.write_accesses);
+			fprintf(file_results, "\nCache Write Accesses: %llu", run.write_accesses);
+			if (cp->sample_counts) {
+				sampling_print_results(cp, run.accesses, file_results);
+			}
+			else {
+				printf("\nCache Hits: %llu", run.hits);
+				fprintf(file_results, "\nCache Hits: %llu", run.hits);
+				printf("\nCache Misses: %llu", run.misses);
+				fprintf(file_results, "\nCache Misses: %llu", run.misses);
+				printf("\nCache Writebacks: %llu", run.misses_with_writeback);
+				fprintf(file_results, "\nCache Writebacks: %llu", run.misses_with_writeback);
+			}
+			if (threec) {
+				threec_print_results(threec, run.accesses, file_results);
+			}
+			if (writebuf) {
+				writebuf_print_results(writebuf, file_results);
+			}
+			if (prefetch) {
+				prefetch_print_results(prefetch, file_results);
+			}
+			if (timing) {
+				printf("\n\nHit Latency: %d cycles", hit_latency);
+				fprintf(file_results, "\n\nHit Latency: %d cycles", hit_latency);
+				printf("\nMemory Latency: %d cycles", memory_latency);
+				fprintf(file_results, "\nMemory Latency: %d cycles", memory_latency);
+				timing_print_results(timing, file_results);
+			}
+			if (miss_stream) {
+				miss_stream_print_results(miss_stream, run.trace_records, file_results);
+			}
+			if (tlb) {
+				tlb_print_results(tlb, file_results);
+			}
+			if (save_name) {
+				checkpoint.now = now;
+				checkpoint.records = run.trace_records;
+				checkpoint.accesses = run.accesses;
+				checkpoint.read_accesses = run.read_accesses;
+				checkpoint.write_accesses = run.write_accesses;
+				checkpoint.hits = run.hits;
+				checkpoint.misses = run.misses;
+				checkpoint.misses_with_writeback = run.misses_with_writeback;
+				if (!checkpoint_save(save_name, cp, &checkpoint)) {
+					fprintf(stdout, "\ncheckpoint %s not written.\n", save_name);
+				}
+				else {
+					printf("\n\nSaved: %s after %llu records", save_name, run.trace_records);
+					fprintf(file_results, "\n\nSaved: %s after %llu records", save_name, run.trace_records);
+				}
+			}
             break;
         }
         else{              /* process only loads and stores */;
-			gettimeofday(&gettimeofdayreturnstruct, NULL);
-			timestamp_in_microsec = (unsigned long long)(1000000ULL * gettimeofdayreturnstruct.tv_sec + gettimeofdayreturnstruct.tv_usec);
+			if (timing) {
+				timing_tick(timing);
+			}
             if (tr_entry->type == ti_LOAD) {
                 if (trace_view_on) {
 					printf("\n\nLOAD %x n",tr_entry->Addr);
 					fprintf(file_results, "\n\nLOAD %x n",tr_entry->Addr); 
 				}
                 // call cache_access(struct cache_t *cp, tr_entry->Addr, access_type)
-				cache_access_status = cache_access(cp, tr_entry->Addr, tr_entry->type, file_results, trace_view_on, timestamp_in_microsec);
-				read_accesses = read_accesses + 1;
-				accesses = accesses + 1;
+				if (tlb) {
+					tlb_access(tlb, tr_entry->Addr, &now);
+				}
+				now = now + 1;
+				cache_access_status = cache_access(cp, tr_entry->Addr, tr_entry->type, file_results, trace_view_on, now);
+				run.read_accesses = run.read_accesses + 1;
+				run.accesses = run.accesses + 1;
             }
             else if (tr_entry->type == ti_STORE) {
                 if (trace_view_on) {
@@ -185,41 +742,70 @@ int main(int argc, char **argv)
 					fprintf(file_results, "\n\nSTORE %x n",tr_entry->Addr) ;
 				}
                 // call cache_access(struct cache_t *cp, tr_entry->Addr, access_type)
-				cache_access_status = cache_access(cp, tr_entry->Addr, tr_entry->type, file_results, trace_view_on, timestamp_in_microsec);
-				write_accesses =  write_accesses + 1;
-				accesses = accesses + 1;
+				if (tlb) {
+					tlb_access(tlb, tr_entry->Addr, &now);
+				}
+				now = now + 1;
+				cache_access_status = cache_access(cp, tr_entry->Addr, tr_entry->type, file_results, trace_view_on, now);
+				run.write_accesses =  run.write_accesses + 1;
+				run.accesses = run.accesses + 1;
             }
 			else {
 				cache_access_status = 100; //not a load or store
 			}
+			if (threec && cache_access_status != 100) {
+				miss_class = threec_access(threec, tr_entry->Addr, cache_access_status);
+			}
+			if (writebuf && cache_access_status != 100) {
+				writebuf_access(writebuf, tr_entry->Addr, tr_entry->type, cache_access_status);
+			}
+			if (miss_stream && cache_access_status != 100) {
+				miss_stream_access(miss_stream, tr_entry, cache_access_status);
+			}
+			if (prefetch && cache_access_status != 100) {
+				prefetch_access(prefetch, tr_entry->Addr, tr_entry->PC, cache_access_status, now);
+			}
+			if (timing && cache_access_status != 100 && cache_access_status != CACHE_NOT_SAMPLED) {
+				timing_access(timing, tr_entry->Addr, cache_access_status != 0, cache_access_status == 0 ? hit_latency : hit_latency + memory_latency);
+			}
             // based on the value returned, update the statisctics for hits, misses and misses_with_writeback
 			if(cache_access_status == 0){ //0 if a hit, 1 if a miss or 2 if a miss_with_write_back
-				hits = hits + 1;
+				run.hits = run.hits + 1;
                 if (trace_view_on) { 
 					printf("\nStatus: hit");
 					fprintf(file_results, "\nStatus: hit");
 				}
 			}
 			else if (cache_access_status == 1) {
-				misses = misses + 1;
+				run.misses = run.misses + 1;
                 if (trace_view_on) {
 					printf("\nStatus: miss");
 					fprintf(file_results, "\nStatus: miss");
 				}
 			}
 			else if (cache_access_status == 2) {
-				misses_with_writeback = misses_with_writeback + 1;
+				run.misses_with_writeback = run.misses_with_writeback + 1;
 				if (trace_view_on) {
 					printf("\nStatus: miss with writeback");
 					fprintf(file_results, "\nStatus: miss with writeback");
 				}					
 			}
+			if (threec && trace_view_on && miss_class >= 0 && (cache_access_status == 1 || cache_access_status == 2)) {
+				printf("\nMiss Class: %s", threec_class_names[miss_class]);
+				fprintf(file_results, "\nMiss Class: %s", threec_class_names[miss_class]);
+			}
+			else if (cache_access_status == CACHE_NOT_SAMPLED) {
+				if (trace_view_on) {
+					printf("\nStatus: not sampled");
+					fprintf(file_results, "\nStatus: not sampled");
+				}
+			}
         }
     }
 	
 	fclose(file_results); //close output file
 	
-    trace_uninit();
+    sim_close(&run);
     
     exit(0);
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Cache checkpoints.
+// A checkpoint holds everything a single run needs to carry on where it stopped:
+// the geometry, policies and set sampling of the cache, every array of the cache_t
+// (tags, timestamps, valid and dirty bits, replacement bits, per-set sample counts),
+// the random state, the logical clock, the trace records read so far and the run's
+// counters.
+//
+//     file = <checkpoint_header> tags timestamps valid dirty repl_bits [sample_counts]
+//
+// The arrays are written in the native layout, so a checkpoint is read back by a
+// build for the same machine.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "skeleton.h"
+
+#define CHECKPOINT_MAGIC "CKP1"
+
+// The run's position and counters, saved along with the cache
+struct checkpoint_stats {
+	unsigned long long now;             // logical clock of the replacement state
+	unsigned long long records;         // trace records read, skipped ones included
+	unsigned long long accesses;
+	unsigned long long read_accesses;
+	unsigned long long write_accesses;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long misses_with_writeback;
+};
+
+struct checkpoint_header {
+	char magic[4];
+	unsigned int header_size;   // sizeof(struct checkpoint_header) of the writer
+	int nsets;
+	int bsize;
+	int assoc;
+	int policy;
+	int mask_words;
+	int repl_words;
+	int write_through;
+	int no_write_allocate;
+	int sample_shift;
+	int sampled;                // 1 if sample_counts follow the other arrays
+	unsigned long long rng;
+	struct checkpoint_stats stats;
+};
+
+// Writes cp and stats to file_name. Returns 1 on success.
+int checkpoint_save(const char *file_name, struct cache_t *cp, const struct checkpoint_stats *stats)
+{
+	struct checkpoint_header h;
+	size_t blocks = (size_t)cp->nsets * cp->assoc;
+	FILE *fd;
+	int ok;
+
+	fd = fopen(file_name, "wb");
+	if (!fd) {
+		return 0;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CHECKPOINT_MAGIC, 4);
+	h.header_size = sizeof(h);
+	h.nsets = cp->nsets;
+	h.bsize = cp->bsize;
+	h.assoc = cp->assoc;
+	h.policy = cp->policy;
+	h.mask_words = cp->mask_words;
+	h.repl_words = cp->repl_words;
+	h.write_through = cp->write_through;
+	h.no_write_allocate = cp->no_write_allocate;
+	h.sample_shift = cp->sample_shift;
+	h.sampled = cp->sample_counts != NULL;
+	h.rng = cp->rng;
+	h.stats = *stats;
+
+	ok = fwrite(&h, sizeof(h), 1, fd) == 1
+		&& fwrite(cp->tags, sizeof(unsigned long long), blocks, fd) == blocks
+		&& fwrite(cp->timestamps, sizeof(unsigned long long), blocks, fd) == blocks
+		&& fwrite(cp->valid, sizeof(unsigned long long), (size_t)cp->nsets * cp->mask_words, fd) == (size_t)cp->nsets * cp->mask_words
+		&& fwrite(cp->dirty, sizeof(unsigned long long), (size_t)cp->nsets * cp->mask_words, fd) == (size_t)cp->nsets * cp->mask_words
+		&& fwrite(cp->repl_bits, sizeof(unsigned long long), (size_t)cp->nsets * cp->repl_words, fd) == (size_t)cp->nsets * cp->repl_words;
+	if (ok && cp->sample_counts) {
+		ok = fwrite(cp->sample_counts, sizeof(unsigned long long), (size_t)(cp->nsets >> cp->sample_shift) * 3, fd) == (size_t)(cp->nsets >> cp->sample_shift) * 3;
+	}
+	if (fclose(fd) != 0) {
+		ok = 0;
+	}
+	return ok;
+}
+
+// Reads a checkpoint into a new cache and fills in stats. Returns NULL (after a message) on a bad file.
+struct cache_t * checkpoint_load(const char *file_name, struct checkpoint_stats *stats)
+{
+	struct checkpoint_header h;
+	struct cache_t *cp;
+	size_t blocks;
+	FILE *fd;
+	int ok;
+
+	fd = fopen(file_name, "rb");
+	if (!fd) {
+		fprintf(stdout, "\ncheckpoint %s not opened.\n", file_name);
+		return NULL;
+	}
+	if (fread(&h, sizeof(h), 1, fd) != 1 || memcmp(h.magic, CHECKPOINT_MAGIC, 4) != 0 || h.header_size != sizeof(h)
+		|| h.nsets <= 0 || h.bsize <= 0 || h.assoc <= 0 || h.policy < 0 || h.policy >= CACHE_NPOLICIES) {
+		fprintf(stdout, "\n%s is not a checkpoint written by this build.\n", file_name);
+		fclose(fd);
+		return NULL;
+	}
+
+	cp = cache_create((int)((long long)h.nsets * h.bsize * h.assoc / 1024), h.bsize, h.assoc, (enum cache_policy)h.policy);
+	cache_set_write_policy(cp, h.write_through, h.no_write_allocate);
+	if (h.sampled) {
+		cache_set_sampling(cp, 1 << h.sample_shift);
+	}
+	cp->rng = h.rng;
+	blocks = (size_t)cp->nsets * cp->assoc;
+
+	ok = cp->nsets == h.nsets && cp->mask_words == h.mask_words && cp->repl_words == h.repl_words
+		&& fread(cp->tags, sizeof(unsigned long long), blocks, fd) == blocks
+		&& fread(cp->timestamps, sizeof(unsigned long long), blocks, fd) == blocks
+		&& fread(cp->valid, sizeof(unsigned long long), (size_t)cp->nsets * cp->mask_words, fd) == (size_t)cp->nsets * cp->mask_words
+		&& fread(cp->dirty, sizeof(unsigned long long), (size_t)cp->nsets * cp->mask_words, fd) == (size_t)cp->nsets * cp->mask_words
+		&& fread(cp->repl_bits, sizeof(unsigned long long), (size_t)cp->nsets * cp->repl_words, fd) == (size_t)cp->nsets * cp->repl_words;
+	if (ok && cp->sample_counts) {
+		ok = cp->sample_shift == h.sample_shift
+			&& fread(cp->sample_counts, sizeof(unsigned long long), (size_t)(cp->nsets >> cp->sample_shift) * 3, fd) == (size_t)(cp->nsets >> cp->sample_shift) * 3;
+	}
+	fclose(fd);
+	if (!ok) {
+		fprintf(stdout, "\ncheckpoint %s is truncated or does not match its header.\n", file_name);
+		cache_free(cp);
+		return NULL;
+	}
+
+	*stats = h.stats;
+	return cp;
+}
+
+#endif
@@ -0,0 +1,439 @@
+#ifndef __COHERENCE_H__
+#define __COHERENCE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Multicore coherence: one trace and one private cache per core, kept coherent
+// with MESI or MOESI by snooping a shared bus in front of memory.
+//
+// The configuration file has:
+//     protocol mesi | moesi
+//     schedule rr | random <quantum>     cores take turns every quantum loads/stores
+//     cache <cache size KB> <block size> <associativity> <replacement policy>
+//     core <trace_file>                  one line per core, in core order
+//
+// The state of a block comes from the valid and dirty bits of its cache_t plus a
+// shared flag kept here:
+//     M = valid, dirty, not shared      O = valid, dirty, shared (MOESI only)
+//     E = valid, clean, not shared      S = valid, clean, shared
+//
+//   load miss  - BusRd; a dirty owner supplies the block. Under MESI the owner writes
+//                it back to memory and drops to S, under MOESI it keeps it as O.
+//                The requester gets S if anyone else holds the block, E otherwise.
+//   store miss - BusRdX; every other copy is invalidated.
+//   store to S or O - BusUpgr; every other copy is invalidated, no data moves.
+//
+// A miss on a block this core lost to another core's invalidation (the invalid way
+// still holds its tag) is counted as a coherence miss.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "trace_reader.h"
+
+#define COH_MAX_CORES 64
+#define COH_LINE_MAX 512
+
+#define COH_SHARED 1       // another cache may hold the block
+#define COH_INVALIDATED 2  // the way was emptied by another core's write
+
+enum coh_protocol {
+	COH_MESI,
+	COH_MOESI
+};
+
+enum coh_schedule {
+	COH_ROUND_ROBIN,
+	COH_RANDOM
+};
+
+char *coh_protocol_names[] = { "MESI", "MOESI" };
+char *coh_schedule_names[] = { "ROUND ROBIN", "RANDOM" };
+
+struct coh_core {
+	char *trace_file_name;
+	struct trace_reader_t *reader;
+	int done;                 // trace exhausted
+	struct cache_t *cp;
+	unsigned char *flags;     // COH_SHARED / COH_INVALIDATED of every way, set * assoc + way
+
+	// statistics for this core only
+	unsigned long long accesses;
+	unsigned long long read_accesses;
+	unsigned long long write_accesses;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long coherence_misses;
+	unsigned long long writebacks;       // dirty victims of this core's misses
+	unsigned long long invalidations;    // blocks taken away by other cores' writes
+	unsigned long long upgrades;         // stores to a shared block
+};
+
+struct coherence_t {
+	enum coh_protocol protocol;
+	enum coh_schedule schedule;
+	int quantum;
+	int cache_size;
+	int block_size;
+	int associativity;
+	int replacement_policy;
+
+	int ncores;
+	struct coh_core cores[COH_MAX_CORES];
+	unsigned long long clock;
+	unsigned long long rng;
+
+	// bus and memory traffic
+	unsigned long long bus_reads;
+	unsigned long long bus_read_exclusives;
+	unsigned long long bus_upgrades;
+	unsigned long long cache_to_cache;
+	unsigned long long memory_reads;
+	unsigned long long memory_writes;
+};
+
+// Reads the configuration, creates the caches and opens every core's trace. Returns NULL on a bad file.
+struct coherence_t * coherence_create(char *config_file_name, enum trace_reader_mode mode)
+{
+	FILE *config_fd;
+	char line[COH_LINE_MAX], word[COH_LINE_MAX];
+	int line_number = 0, have_cache = 0, i;
+	struct coherence_t *C;
+	struct coh_core *core;
+
+	config_fd = fopen(config_file_name, "r");
+	if (!config_fd) {
+		fprintf(stdout, "\ncoherence file %s not opened.\n", config_file_name);
+		return NULL;
+	}
+
+	C = (struct coherence_t *)calloc(1, sizeof(struct coherence_t));
+	C->quantum = 1;
+	C->rng = 0x9E3779B97F4A7C15ULL; // fixed seed so runs are repeatable
+
+	while (fgets(line, sizeof(line), config_fd)) {
+		char *p = line;
+		line_number++;
+
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+		if (sscanf(p, "protocol %511s", word) == 1) {
+			if (strcmp(word, "mesi") == 0) C->protocol = COH_MESI;
+			else if (strcmp(word, "moesi") == 0) C->protocol = COH_MOESI;
+			else {
+				fprintf(stdout, "\n%s:%d: protocol has to be mesi or moesi.\n", config_file_name, line_number);
+				fclose(config_fd);
+				return NULL;
+			}
+		}
+		else if (sscanf(p, "schedule %511s %d", word, &C->quantum) == 2) {
+			if (strcmp(word, "rr") == 0) C->schedule = COH_ROUND_ROBIN;
+			else if (strcmp(word, "random") == 0) C->schedule = COH_RANDOM;
+			else C->quantum = 0;
+			if (C->quantum <= 0) {
+				fprintf(stdout, "\n%s:%d: expected schedule rr|random <quantum>\n", config_file_name, line_number);
+				fclose(config_fd);
+				return NULL;
+			}
+		}
+		else if (sscanf(p, "cache %d %d %d %d", &C->cache_size, &C->block_size, &C->associativity, &C->replacement_policy) == 4) {
+			if (C->cache_size <= 0 || C->block_size <= 0 || C->associativity <= 0
+				|| (C->cache_size != (C->cache_size & -C->cache_size))
+				|| (C->block_size != (C->block_size & -C->block_size))
+				|| (C->associativity != (C->associativity & -C->associativity))) {
+				fprintf(stdout, "\n%s:%d: cache size, block size, and block associativity have to be a power of 2.\n", config_file_name, line_number);
+				fclose(config_fd);
+				return NULL;
+			}
+			if (!(C->replacement_policy >= 0 && C->replacement_policy < CACHE_NPOLICIES_ONLINE)) {
+				fprintf(stdout, "\n%s:%d: pick a replacement policy from 0 to %d (OPT only runs as a single cache).\n", config_file_name, line_number, CACHE_NPOLICIES_ONLINE - 1);
+				fclose(config_fd);
+				return NULL;
+			}
+			have_cache = 1;
+		}
+		else if (sscanf(p, "core %511s", word) == 1) {
+			if (C->ncores == COH_MAX_CORES) {
+				fprintf(stdout, "\n%s:%d: at most %d cores are supported.\n", config_file_name, line_number, COH_MAX_CORES);
+				fclose(config_fd);
+				return NULL;
+			}
+			C->cores[C->ncores].trace_file_name = strdup(word);
+			C->ncores++;
+		}
+		else {
+			fprintf(stdout, "\n%s:%d: expected a protocol, schedule, cache or core line.\n", config_file_name, line_number);
+			fclose(config_fd);
+			return NULL;
+		}
+	}
+	fclose(config_fd);
+
+	if (!have_cache || C->ncores == 0) {
+		fprintf(stdout, "\ncoherence file %s needs a cache line and at least one core.\n", config_file_name);
+		return NULL;
+	}
+
+	for (i = 0; i < C->ncores; i++) {
+		core = &C->cores[i];
+		core->reader = trace_reader_open(core->trace_file_name, mode);
+		if (!core->reader) {
+			fprintf(stdout, "\ntrace file %s not opened.\n", core->trace_file_name);
+			return NULL;
+		}
+		core->cp = cache_create(C->cache_size, C->block_size, C->associativity, (enum cache_policy)C->replacement_policy);
+		core->flags = (unsigned char *)calloc((size_t)core->cp->nsets * core->cp->assoc, 1);
+	}
+
+	return C;
+}
+
+// Returns the way of cp holding address (and its set), or -1
+int coherence_find(struct cache_t *cp, unsigned long address, unsigned long *set)
+{
+	unsigned long tag;
+
+	cache_decompose(cp, address, &tag, set);
+	return cache_find_way(cp, (int)*set, tag);
+}
+
+// Returns 1 if a cache other than core c's holds address in M or O
+int coherence_dirty_elsewhere(struct coherence_t *C, int c, unsigned long address)
+{
+	struct cache_t *cp;
+	unsigned long set;
+	int i, way;
+
+	for (i = 0; i < C->ncores; i++) {
+		if (i == c) continue;
+		cp = C->cores[i].cp;
+		way = coherence_find(cp, address, &set);
+		if (way >= 0 && (cp->dirty[CACHE_WAY_WORD(cp, set, way)] & CACHE_WAY_BIT(way))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Removes every copy of address outside core c, after a BusRdX or BusUpgr
+void coherence_invalidate_others(struct coherence_t *C, int c, unsigned long address)
+{
+	struct coh_core *other;
+	unsigned long set;
+	int i, way;
+
+	for (i = 0; i < C->ncores; i++) {
+		if (i == c) continue;
+		other = &C->cores[i];
+		way = coherence_find(other->cp, address, &set);
+		if (way < 0) continue;
+
+		// the dirty data, if any, moves to the writer, so nothing goes to memory
+		cache_invalidate(other->cp, address);
+		other->flags[set * other->cp->assoc + way] = COH_INVALIDATED;
+		other->invalidations++;
+	}
+}
+
+// Snoops a BusRd for address from core c. Returns 1 if another cache keeps a copy.
+int coherence_bus_read(struct coherence_t *C, int c, unsigned long address)
+{
+	struct coh_core *other;
+	unsigned long set;
+	int i, way, shared = 0, supplied = 0;
+	size_t word;
+
+	for (i = 0; i < C->ncores; i++) {
+		if (i == c) continue;
+		other = &C->cores[i];
+		way = coherence_find(other->cp, address, &set);
+		if (way < 0) continue;
+
+		shared = 1;
+		other->flags[set * other->cp->assoc + way] |= COH_SHARED;
+		word = CACHE_WAY_WORD(other->cp, set, way);
+		if (other->cp->dirty[word] & CACHE_WAY_BIT(way)) {
+			// M or O: the owner supplies the block
+			supplied = 1;
+			if (C->protocol == COH_MESI) {
+				// M -> S, the memory copy is brought up to date
+				other->cp->dirty[word] &= ~CACHE_WAY_BIT(way);
+				C->memory_writes++;
+			}
+		}
+	}
+
+	if (supplied) C->cache_to_cache++;
+	else C->memory_reads++;
+	return shared;
+}
+
+// Simulates one load or store of core c
+void coherence_access(struct coherence_t *C, int c, unsigned long address, char access_type)
+{
+	struct coh_core *core = &C->cores[c];
+	struct cache_t *cp = core->cp;
+	unsigned long set, tag;
+	unsigned char *flags;
+	int way, status, shared = 0, i;
+
+	C->clock++;
+	core->accesses++;
+	if (access_type == ti_LOAD) core->read_accesses++;
+	else core->write_accesses++;
+
+	way = coherence_find(cp, address, &set);
+	if (way >= 0) {
+		flags = &core->flags[set * cp->assoc + way];
+		if (access_type == ti_STORE && (*flags & COH_SHARED)) {
+			// S or O -> M
+			C->bus_upgrades++;
+			core->upgrades++;
+			coherence_invalidate_others(C, c, address);
+			*flags = 0;
+		}
+		// E -> M on a store is silent; cache_access_block marks the block dirty
+		cache_access_block(cp, address >> cp->tag_shift, set, access_type, C->clock);
+		core->hits++;
+		return;
+	}
+
+	// a way that still holds the tag was emptied by an invalidation
+	tag = address >> cp->tag_shift;
+	for (i = 0; i < cp->assoc; i++) {
+		if ((core->flags[set * cp->assoc + i] & COH_INVALIDATED) && cp->tags[set * cp->assoc + i] == tag
+			&& !(cp->valid[CACHE_WAY_WORD(cp, set, i)] & CACHE_WAY_BIT(i))) {
+			core->coherence_misses++;
+			break;
+		}
+	}
+
+	if (access_type == ti_LOAD) {
+		C->bus_reads++;
+		shared = coherence_bus_read(C, c, address);
+	}
+	else {
+		C->bus_read_exclusives++;
+		if (coherence_dirty_elsewhere(C, c, address)) C->cache_to_cache++;
+		else C->memory_reads++;
+		coherence_invalidate_others(C, c, address);
+	}
+
+	status = cache_access_block(cp, tag, set, access_type, C->clock);
+	core->misses++;
+	if (status == 2) {
+		core->writebacks++;
+		C->memory_writes++;
+	}
+	way = cache_find_way(cp, (int)set, tag);
+	core->flags[set * cp->assoc + way] = shared ? COH_SHARED : 0;
+}
+
+// Runs every core's trace to the end, switching cores as the schedule says
+void coherence_run(struct coherence_t *C)
+{
+	const struct trace_item *tr_entry;
+	struct coh_core *core;
+	int live = C->ncores, c = 0, n;
+
+	while (live) {
+		if (C->schedule == COH_RANDOM) {
+			do {
+				C->rng ^= C->rng << 13;
+				C->rng ^= C->rng >> 7;
+				C->rng ^= C->rng << 17;
+				c = (int)(C->rng % (unsigned long long)C->ncores);
+			} while (C->cores[c].done);
+		}
+		core = &C->cores[c];
+
+		// one quantum of loads and stores, or less if the trace ends
+		for (n = 0; n < C->quantum; ) {
+			if (!trace_reader_next(core->reader, &tr_entry)) {
+				core->done = 1;
+				live--;
+				break;
+			}
+			if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+				coherence_access(C, c, tr_entry->Addr, tr_entry->type);
+				n++;
+			}
+		}
+
+		if (C->schedule == COH_ROUND_ROBIN && live) {
+			do {
+				c = (c + 1) % C->ncores;
+			} while (C->cores[c].done);
+		}
+	}
+}
+
+void coherence_print_results(struct coherence_t *C, FILE *file_results)
+{
+	struct coh_core *core;
+	int i;
+
+	printf("\n\nParameters:");
+	fprintf(file_results, "\n\nParameters:");
+	printf("\nProtocol: %s", coh_protocol_names[C->protocol]);
+	fprintf(file_results, "\nProtocol: %s", coh_protocol_names[C->protocol]);
+	printf("\nSchedule: %s, %d accesses per turn", coh_schedule_names[C->schedule], C->quantum);
+	fprintf(file_results, "\nSchedule: %s, %d accesses per turn", coh_schedule_names[C->schedule], C->quantum);
+	printf("\nPrivate Caches: %d KBYTES, %d BYTES blocks, %d-way, %s", C->cache_size, C->block_size, C->associativity, cache_policy_names[C->replacement_policy]);
+	fprintf(file_results, "\nPrivate Caches: %d KBYTES, %d BYTES blocks, %d-way, %s", C->cache_size, C->block_size, C->associativity, cache_policy_names[C->replacement_policy]);
+
+	for (i = 0; i < C->ncores; i++) {
+		core = &C->cores[i];
+
+		printf("\n\nCore %d: %s", i, core->trace_file_name);
+		fprintf(file_results, "\n\nCore %d: %s", i, core->trace_file_name);
+		printf("\nCore %d Accesses: %llu", i, core->accesses);
+		fprintf(file_results, "\nCore %d Accesses: %llu", i, core->accesses);
+		printf("\nCore %d Read Accesses: %llu", i, core->read_accesses);
+		fprintf(file_results, "\nCore %d Read Accesses: %llu", i, core->read_accesses);
+		printf("\nCore %d Write Accesses: %llu", i, core->write_accesses);
+		fprintf(file_results, "\nCore %d Write Accesses: %llu", i, core->write_accesses);
+		printf("\nCore %d Hits: %llu", i, core->hits);
+		fprintf(file_results, "\nCore %d Hits: %llu", i, core->hits);
+		printf("\nCore %d Misses: %llu", i, core->misses);
+		fprintf(file_results, "\nCore %d Misses: %llu", i, core->misses);
+		printf("\nCore %d Coherence Misses: %llu", i, core->coherence_misses);
+		fprintf(file_results, "\nCore %d Coherence Misses: %llu", i, core->coherence_misses);
+		printf("\nCore %d Writebacks: %llu", i, core->writebacks);
+		fprintf(file_results, "\nCore %d Writebacks: %llu", i, core->writebacks);
+		printf("\nCore %d Invalidations: %llu", i, core->invalidations);
+		fprintf(file_results, "\nCore %d Invalidations: %llu", i, core->invalidations);
+		printf("\nCore %d Upgrades: %llu", i, core->upgrades);
+		fprintf(file_results, "\nCore %d Upgrades: %llu", i, core->upgrades);
+	}
+
+	printf("\n\nBus Reads: %llu", C->bus_reads);
+	fprintf(file_results, "\n\nBus Reads: %llu", C->bus_reads);
+	printf("\nBus Read Exclusives: %llu", C->bus_read_exclusives);
+	fprintf(file_results, "\nBus Read Exclusives: %llu", C->bus_read_exclusives);
+	printf("\nBus Upgrades: %llu", C->bus_upgrades);
+	fprintf(file_results, "\nBus Upgrades: %llu", C->bus_upgrades);
+	printf("\nCache-to-Cache Transfers: %llu", C->cache_to_cache);
+	fprintf(file_results, "\nCache-to-Cache Transfers: %llu", C->cache_to_cache);
+	printf("\nMemory Reads: %llu", C->memory_reads);
+	fprintf(file_results, "\nMemory Reads: %llu", C->memory_reads);
+	printf("\nMemory Writes: %llu", C->memory_writes);
+	fprintf(file_results, "\nMemory Writes: %llu", C->memory_writes);
+}
+
+void coherence_close(struct coherence_t *C)
+{
+	int i;
+
+	for (i = 0; i < C->ncores; i++) {
+		trace_reader_close(C->cores[i].reader);
+		free(C->cores[i].trace_file_name);
+	}
+}
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef __COMPACT_TRACE_H__
+#define __COMPACT_TRACE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Compact memory-only trace format (.mtr).
+// Only ti_LOAD and ti_STORE records are kept, since the simulator ignores every
+// other type. Each record is one varint holding the zigzag-encoded difference from
+// the previous address, shifted left by one with the store bit in bit 0, followed
+// (when MTR_FLAG_PC is set) by a varint of the zigzag-encoded PC difference.
+//
+// Records are grouped into blocks of up to MTR_BLOCK_RECORDS. Deltas restart from
+// zero at every block, so any block can be decoded on its own; an index of block
+// offsets at the end of the file makes them reachable without decoding the rest.
+//
+//     header | block 0 | block 1 | ... | index
+//     block  = <uint32 records> <uint32 payload bytes> <payload>
+//     index  = n_blocks * <uint64 file offset> <uint64 first record number>
+//
+// Integers in the header, block headers and index are stored in host byte order,
+// the same as the raw trace_item format.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+
+#define MTR_MAGIC "MTR1"
+#define MTR_FLAG_PC 1                  // PC deltas are stored
+#define MTR_BLOCK_RECORDS 65536
+#define MTR_MAX_RECORD_BYTES 10        // two 5-byte varints
+#define MTR_MAX_BLOCK_BYTES (MTR_BLOCK_RECORDS * MTR_MAX_RECORD_BYTES)
+
+struct mtr_header {
+	char magic[4];
+	unsigned int flags;
+	unsigned long long n_records;
+	unsigned long long n_blocks;
+	unsigned long long index_offset;
+};
+
+struct mtr_index_entry {
+	unsigned long long offset;        // file offset of the block header
+	unsigned long long first_record;  // number of the block's first record
+};
+
+struct mtr_block_header {
+	unsigned int n_records;
+	unsigned int n_bytes;
+};
+
+// Encoder state; records are buffered until a whole block can be written
+struct mtr_writer {
+	FILE *fd;
+	struct mtr_header header;
+	struct trace_item *pending;
+	int n_pending;
+	unsigned char *bytes;
+	struct mtr_index_entry *index;
+	unsigned long long index_cap;
+};
+
+// Decoder state for sequential reading
+struct mtr_reader {
+	struct mtr_header header;
+	unsigned long long blocks_left;
+	unsigned char *bytes;
+};
+
+static inline unsigned int mtr_zigzag(int v)
+{
+	return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static inline int mtr_unzigzag(unsigned int v)
+{
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static inline int mtr_put_varint(unsigned char *p, unsigned long long v)
+{
+	int n = 0;
+	while (v >= 0x80) {
+		p[n++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (unsigned char)v;
+	return n;
+}
+
+static inline unsigned long long mtr_get_varint(const unsigned char **p)
+{
+	unsigned long long v = 0;
+	int shift = 0;
+	while (**p & 0x80) {
+		v |= (unsigned long long)(**p & 0x7f) << shift;
+		shift += 7;
+		(*p)++;
+	}
+	v |= (unsigned long long)**p << shift;
+	(*p)++;
+	return v;
+}
+
+// Encodes n load/store records into out and returns the number of bytes written
+int mtr_encode_block(const struct trace_item *items, int n, unsigned int flags, unsigned char *out)
+{
+	unsigned int prev_addr = 0, prev_pc = 0;
+	unsigned char *p = out;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		unsigned long long v = mtr_zigzag((int)(items[i].Addr - prev_addr));
+		p += mtr_put_varint(p, (v << 1) | (items[i].type == ti_STORE));
+		prev_addr = items[i].Addr;
+		if (flags & MTR_FLAG_PC) {
+			p += mtr_put_varint(p, mtr_zigzag((int)(items[i].PC - prev_pc)));
+			prev_pc = items[i].PC;
+		}
+	}
+
+	return (int)(p - out);
+}
+
+// Decodes n records from in; fields that are not stored come back as zero
+void mtr_decode_block(const unsigned char *in, int n, unsigned int flags, struct trace_item *out)
+{
+	unsigned int addr = 0, pc = 0;
+	unsigned long long v;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		v = mtr_get_varint(&in);
+		addr += (unsigned int)mtr_unzigzag((unsigned int)(v >> 1));
+		if (flags & MTR_FLAG_PC) {
+			pc += (unsigned int)mtr_unzigzag((unsigned int)mtr_get_varint(&in));
+		}
+		out[i].type = (v & 1) ? ti_STORE : ti_LOAD;
+		out[i].sReg_a = 0;
+		out[i].sReg_b = 0;
+		out[i].dReg = 0;
+		out[i].PC = pc;
+		out[i].Addr = addr;
+	}
+}
+
+struct mtr_writer * mtr_writer_open(char *file_name, unsigned int flags)
+{
+	struct mtr_writer *W = (struct mtr_writer *)calloc(1, sizeof(struct mtr_writer));
+
+	W->fd = fopen(file_name, "wb");
+	if (!W->fd) {
+		free(W);
+		return NULL;
+	}
+	memcpy(W->header.magic, MTR_MAGIC, 4);
+	W->header.flags = flags;
+	W->pending = (struct trace_item *)malloc(MTR_BLOCK_RECORDS * sizeof(struct trace_item));
+	W->bytes = (unsigned char *)malloc(MTR_MAX_BLOCK_BYTES);
+	W->index_cap = 1024;
+	W->index = (struct mtr_index_entry *)malloc(W->index_cap * sizeof(struct mtr_index_entry));
+
+	// the header is rewritten with the final counts on close
+	fwrite(&W->header, sizeof(W->header), 1, W->fd);
+	return W;
+}
+
+void mtr_writer_flush(struct mtr_writer *W)
+{
+	struct mtr_block_header bh;
+
+	if (!W->n_pending) return;
+
+	if (W->header.n_blocks == W->index_cap) {
+		W->index_cap = W->index_cap * 2;
+		W->index = (struct mtr_index_entry *)realloc(W->index, W->index_cap * sizeof(struct mtr_index_entry));
+	}
+	W->index[W->header.n_blocks].offset = (unsigned long long)ftello(W->fd);
+	W->index[W->header.n_blocks].first_record = W->header.n_records;
+
+	bh.n_records = W->n_pending;
+	bh.n_bytes = mtr_encode_block(W->pending, W->n_pending, W->header.flags, W->bytes);
+	fwrite(&bh, sizeof(bh), 1, W->fd);
+	fwrite(W->bytes, 1, bh.n_bytes, W->fd);
+
+	W->header.n_blocks++;
+	W->header.n_records += W->n_pending;
+	W->n_pending = 0;
+}
+
+// Adds one record; anything but a load or store is dropped. Returns 1 if the record was kept.
+int mtr_writer_add(struct mtr_writer *W, const struct trace_item *item)
+{
+	if (item->type != ti_LOAD && item->type != ti_STORE) {
+		return 0;
+	}
+	W->pending[W->n_pending] = *item;
+	W->n_pending++;
+	if (W->n_pending == MTR_BLOCK_RECORDS) {
+		mtr_writer_flush(W);
+	}
+	return 1;
+}
+
+// Writes the last block, the index and the final header. Returns the file size in bytes.
+unsigned long long mtr_writer_close(struct mtr_writer *W)
+{
+	unsigned long long size;
+
+	mtr_writer_flush(W);
+	W->header.index_offset = (unsigned long long)ftello(W->fd);
+	fwrite(W->index, sizeof(struct mtr_index_entry), W->header.n_blocks, W->fd);
+	size = (unsigned long long)ftello(W->fd);
+
+	fseeko(W->fd, 0, SEEK_SET);
+	fwrite(&W->header, sizeof(W->header), 1, W->fd);
+	fclose(W->fd);
+
+	free(W->pending);
+	free(W->bytes);
+	free(W->index);
+	free(W);
+	return size;
+}
+
+// Returns 1 if fd starts with a compact trace header, leaving fd at the start either way.
+// Streams that cannot seek (pipes) are taken to be raw traces.
+int mtr_detect(FILE *fd)
+{
+	char magic[4];
+	int is_compact;
+
+	if (fseeko(fd, 0, SEEK_SET)) {
+		return 0;
+	}
+	is_compact = fread(magic, 1, 4, fd) == 4 && memcmp(magic, MTR_MAGIC, 4) == 0;
+	fseeko(fd, 0, SEEK_SET);
+	return is_compact;
+}
+
+int mtr_reader_open(FILE *fd, struct mtr_reader *M)
+{
+	if (fread(&M->header, sizeof(M->header), 1, fd) != 1) {
+		return 0;
+	}
+	M->blocks_left = M->header.n_blocks;
+	M->bytes = (unsigned char *)malloc(MTR_MAX_BLOCK_BYTES);
+	return 1;
+}
+
+// Decodes the next block into out (room for MTR_BLOCK_RECORDS). Returns the record count, 0 at the end.
+int mtr_reader_next_block(FILE *fd, struct mtr_reader *M, struct trace_item *out)
+{
+	struct mtr_block_header bh;
+
+	if (!M->blocks_left) return 0;
+	if (fread(&bh, sizeof(bh), 1, fd) != 1 || bh.n_records > MTR_BLOCK_RECORDS || bh.n_bytes > MTR_MAX_BLOCK_BYTES
+		|| fread(M->bytes, 1, bh.n_bytes, fd) != bh.n_bytes) {
+		fprintf(stdout, "\n** compact trace is truncated or corrupt\n");
+		M->blocks_left = 0;
+		return 0;
+	}
+	M->blocks_left--;
+
+	mtr_decode_block(M->bytes, bh.n_records, M->header.flags, out);
+	return bh.n_records;
+}
+
+void mtr_reader_close(struct mtr_reader *M)
+{
+	free(M->bytes);
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef __COMPRESSED_TRACE_H__
+#define __COMPRESSED_TRACE_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Compressed traces.
+// A gzip or zstd file is recognized by its magic number and replaced by a stream
+// that decompresses as it is read (glibc fopencookie), so the readers above it see
+// the trace as it was before compression: a raw trace or a compact .mtr one, read
+// with fread. Seeking is emulated: backwards restarts the decompression, forwards
+// reads and discards, which is all the format detection needs.
+//
+// gzip needs zlib (link with -lz; build with -DNO_ZLIB to leave it out), zstd needs
+// libzstd and -DHAVE_ZSTD (link with -lzstd).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifndef NO_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define COMPRESSED_BUFSIZE (256*1024)
+
+enum compressed_format {
+	COMPRESSED_NONE,
+	COMPRESSED_GZIP,
+	COMPRESSED_ZSTD
+};
+
+const char *compressed_format_names[] = { "none", "gzip", "zstd" };
+
+// Returns the compression of fd from its first bytes, and leaves fd at its start
+enum compressed_format compressed_detect(FILE *fd)
+{
+	unsigned char magic[4];
+	enum compressed_format format = COMPRESSED_NONE;
+
+	if (fseeko(fd, 0, SEEK_SET)) {
+		return COMPRESSED_NONE;
+	}
+	if (fread(magic, 1, 4, fd) == 4) {
+		if (magic[0] == 0x1f && magic[1] == 0x8b) {
+			format = COMPRESSED_GZIP;
+		}
+		else if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+			format = COMPRESSED_ZSTD;
+		}
+	}
+	fseeko(fd, 0, SEEK_SET);
+	return format;
+}
+
+#ifndef NO_ZLIB
+ssize_t compressed_gzip_read(void *cookie, char *buf, size_t size)
+{
+	int n = gzread((gzFile)cookie, buf, size > 0x40000000 ? 0x40000000 : (unsigned int)size);
+
+	return n < 0 ? -1 : n;
+}
+
+int compressed_gzip_seek(void *cookie, off64_t *offset, int whence)
+{
+	z_off_t pos;
+
+	if (whence == SEEK_END) {
+		return -1;
+	}
+	pos = gzseek((gzFile)cookie, (z_off_t)*offset, whence);
+	if (pos < 0) {
+		return -1;
+	}
+	*offset = pos;
+	return 0;
+}
+
+int compressed_gzip_close(void *cookie)
+{
+	return gzclose((gzFile)cookie) == Z_OK ? 0 : -1;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+struct compressed_zstd {
+	FILE *fd;
+	ZSTD_DCtx *dctx;
+	ZSTD_inBuffer in;
+	void *in_buf;
+	size_t in_size;
+	unsigned long long pos;     // decompressed bytes handed out so far
+	int eof;
+};
+
+ssize_t compressed_zstd_read(void *cookie, char *buf, size_t size)
+{
+	struct compressed_zstd *Z = (struct compressed_zstd *)cookie;
+	ZSTD_outBuffer out = { buf, size, 0 };
+	size_t ret, before;
+
+	while (out.pos < out.size) {
+		if (Z->in.pos == Z->in.size && !Z->eof) {
+			Z->in.size = fread(Z->in_buf, 1, Z->in_size, Z->fd);
+			Z->in.pos = 0;
+			Z->eof = Z->in.size == 0;
+		}
+		before = out.pos;
+		ret = ZSTD_decompressStream(Z->dctx, &out, &Z->in);
+		if (ZSTD_isError(ret)) {
+			return -1;
+		}
+		// the input is used up and the decoder has nothing left to flush
+		if (Z->eof && out.pos == before) break;
+	}
+	Z->pos += out.pos;
+	return (ssize_t)out.pos;
+}
+
+int compressed_zstd_seek(void *cookie, off64_t *offset, int whence)
+{
+	struct compressed_zstd *Z = (struct compressed_zstd *)cookie;
+	unsigned long long target;
+	char skip[4096];
+	ssize_t n;
+
+	if (whence == SEEK_END) {
+		return -1;
+	}
+	target = (whence == SEEK_CUR) ? Z->pos + *offset : (unsigned long long)*offset;
+	if (target < Z->pos) {
+		// start over from the first frame
+		if (fseeko(Z->fd, 0, SEEK_SET)) {
+			return -1;
+		}
+		ZSTD_DCtx_reset(Z->dctx, ZSTD_reset_session_only);
+		Z->in.size = Z->in.pos = 0;
+		Z->pos = 0;
+		Z->eof = 0;
+	}
+	while (Z->pos < target) {
+		n = compressed_zstd_read(Z, skip, target - Z->pos < sizeof(skip) ? (size_t)(target - Z->pos) : sizeof(skip));
+		if (n <= 0) {
+			return -1;
+		}
+	}
+	*offset = (off64_t)Z->pos;
+	return 0;
+}
+
+int compressed_zstd_close(void *cookie)
+{
+	struct compressed_zstd *Z = (struct compressed_zstd *)cookie;
+	int ret = fclose(Z->fd);
+
+	ZSTD_freeDCtx(Z->dctx);
+	free(Z->in_buf);
+	free(Z);
+	return ret;
+}
+#endif
+
+/*
+	Returns a stream of the decompressed contents of fd, which it takes over (it is closed
+	with the stream), or NULL if this build cannot read the format; fd is left open then.
+*/
+FILE * compressed_open(FILE *fd, enum compressed_format format)
+{
+#ifndef NO_ZLIB
+	if (format == COMPRESSED_GZIP) {
+		cookie_io_functions_t io = { compressed_gzip_read, NULL, compressed_gzip_seek, compressed_gzip_close };
+		FILE *stream;
+		gzFile gz;
+		int gz_fd = dup(fileno(fd));
+
+		// the copy shares the file offset, which the stdio buffer of fd has moved
+		if (gz_fd < 0 || lseek(gz_fd, 0, SEEK_SET) != 0) {
+			if (gz_fd >= 0) close(gz_fd);
+			return NULL;
+		}
+		gz = gzdopen(gz_fd, "rb");
+		if (!gz) {
+			close(gz_fd);
+			return NULL;
+		}
+		gzbuffer(gz, COMPRESSED_BUFSIZE);
+		stream = fopencookie(gz, "rb", io);
+		if (!stream) {
+			gzclose(gz);
+			return NULL;
+		}
+		fclose(fd);
+		return stream;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	if (format == COMPRESSED_ZSTD) {
+		cookie_io_functions_t io = { compressed_zstd_read, NULL, compressed_zstd_seek, compressed_zstd_close };
+		struct compressed_zstd *Z = (struct compressed_zstd *)calloc(1, sizeof(struct compressed_zstd));
+		FILE *stream;
+
+		Z->fd = fd;
+		Z->dctx = ZSTD_createDCtx();
+		Z->in_size = ZSTD_DStreamInSize();
+		Z->in_buf = malloc(Z->in_size);
+		Z->in.src = Z->in_buf;
+		stream = fopencookie(Z, "rb", io);
+		if (!stream) {
+			ZSTD_freeDCtx(Z->dctx);
+			free(Z->in_buf);
+			free(Z);
+			return NULL;
+		}
+		return stream;
+	}
+#endif
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,86 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Renders a binary event log written with -eventlog (event_log.h).
+//
+//     event_dump <log_file>          text, in the layout of the old trace view
+//     event_dump -csv <log_file>     one CSV row per access
+//
+// Build: gcc -O2 -pthread -o event_dump event_dump.c -lm
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _FILE_OFFSET_BITS 64 //traces and logs larger than 2 GB on 32-bit hosts
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_item.h"
+#include "event_log.h"
+
+#define DUMP_CHUNK 4096
+
+char *event_outcome_names[] = { "hit", "miss", "miss with writeback" };
+char *event_victim_names[] = { "none", "clean", "dirty" };
+
+int main(int argc, char **argv)
+{
+	FILE *log_fd;
+	struct event_log_header header;
+	struct event_record *records;
+	unsigned long long index = 0;
+	int csv = 0, arg = 1, n, i;
+
+	if (arg < argc && strcmp(argv[arg], "-csv") == 0) {
+		csv = 1;
+		arg++;
+	}
+	if (argc - arg != 1) {
+		fprintf(stdout, "\nUSAGE: event_dump [-csv] <log_file>\n\n");
+		exit(0);
+	}
+
+	log_fd = fopen(argv[arg], "rb");
+	if (!log_fd) {
+		fprintf(stdout, "\nlog file %s not opened.\n\n", argv[arg]);
+		exit(0);
+	}
+	if (fread(&header, sizeof(header), 1, log_fd) != 1 || memcmp(header.magic, EVLOG_MAGIC, 4) != 0
+		|| header.record_size != sizeof(struct event_record)) {
+		fprintf(stdout, "\n%s is not an event log.\n\n", argv[arg]);
+		exit(0);
+	}
+
+	// large stdio buffer, the output is usually much bigger than the log
+	setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+	records = (struct event_record *)malloc(DUMP_CHUNK * sizeof(struct event_record));
+
+	if (csv) {
+		printf("index,type,address,set,tag,outcome,victim,victim_address\n");
+	}
+	while ((n = (int)fread(records, sizeof(struct event_record), DUMP_CHUNK, log_fd)) > 0) {
+		for (i = 0; i < n; i++, index++) {
+			struct event_record *r = &records[i];
+			const char *type = (r->type == ti_STORE) ? "STORE" : "LOAD";
+			int outcome = r->outcome <= 2 ? r->outcome : 1;
+			int victim = r->victim <= 2 ? r->victim : 0;
+
+			if (csv) {
+				printf("%llu,%s,0x%llx,%u,0x%llx,%s,%s,0x%llx\n", index, type, r->address, r->set, r->tag,
+					event_outcome_names[outcome], event_victim_names[victim], r->victim_address);
+			}
+			else {
+				printf("\n%s %llx", type, r->address);
+				printf("\nTag: %llx", r->tag);
+				printf("\nSet Number: %u", r->set);
+				printf("\nStatus: %s", event_outcome_names[outcome]);
+				if (victim) {
+					printf("\nVictim: %llx (%s)", r->victim_address, event_victim_names[victim]);
+				}
+				printf("\n");
+			}
+		}
+	}
+
+	free(records);
+	fclose(log_fd);
+	exit(0);
+}
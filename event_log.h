@@ -0,0 +1,184 @@
+#ifndef __EVENT_LOG_H__
+#define __EVENT_LOG_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Binary per-access event log.
+// Every simulated access becomes one fixed-size event_record. Records are collected
+// in large buffers and a writer thread does the fwrite calls, so the simulator never
+// waits on the output file unless every buffer is still being written.
+// event_dump renders a log as text (the old trace view) or CSV.
+//
+//     file = <event_log_header> <event_record> ...
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace_item.h"
+#include "skeleton.h"
+
+#define EVLOG_MAGIC "EVL1"
+#define EVLOG_BUFFERS 4
+#define EVLOG_BUFFER_RECORDS (64*1024)
+
+struct event_log_header {
+	char magic[4];
+	unsigned int record_size;   // sizeof(struct event_record) of the writer
+};
+
+struct event_record {
+	unsigned long long address;
+	unsigned long long tag;
+	unsigned long long victim_address; // block replaced by a miss, when victim is not 0
+	unsigned int set;
+	unsigned char type;                // ti_LOAD or ti_STORE
+	unsigned char outcome;             // cache_access status: 0 hit, 1 miss, 2 miss with writeback
+	unsigned char victim;              // 0 no block replaced, 1 clean victim, 2 dirty victim
+	unsigned char pad;
+};
+
+struct event_log_t {
+	FILE *fd;
+	struct event_record *buffers[EVLOG_BUFFERS];
+	int counts[EVLOG_BUFFERS];
+	int full[EVLOG_BUFFERS];   // set when a buffer is handed to the writer
+	int current;               // buffer being filled
+	int n;                     // records in the current buffer
+	int stop;
+	unsigned long long records;
+
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+};
+
+void * event_log_write(void *arg)
+{
+	struct event_log_t *E = (struct event_log_t *)arg;
+	int tail = 0;
+
+	while (1) {
+		pthread_mutex_lock(&E->lock);
+		while (!E->full[tail] && !E->stop) {
+			pthread_cond_wait(&E->filled, &E->lock);
+		}
+		if (!E->full[tail]) {
+			// stopped and everything handed over has been written
+			pthread_mutex_unlock(&E->lock);
+			break;
+		}
+		pthread_mutex_unlock(&E->lock);
+
+		fwrite(E->buffers[tail], sizeof(struct event_record), E->counts[tail], E->fd);
+
+		pthread_mutex_lock(&E->lock);
+		E->full[tail] = 0;
+		pthread_cond_signal(&E->drained);
+		pthread_mutex_unlock(&E->lock);
+		tail = (tail + 1) % EVLOG_BUFFERS;
+	}
+
+	return NULL;
+}
+
+// Creates the log file and starts the writer thread. Returns NULL if the file cannot be created.
+struct event_log_t * event_log_open(char *file_name)
+{
+	struct event_log_t *E;
+	struct event_log_header header;
+	int i;
+
+	E = (struct event_log_t *)calloc(1, sizeof(struct event_log_t));
+	E->fd = fopen(file_name, "wb");
+	if (!E->fd) {
+		free(E);
+		return NULL;
+	}
+
+	memcpy(header.magic, EVLOG_MAGIC, 4);
+	header.record_size = sizeof(struct event_record);
+	fwrite(&header, sizeof(header), 1, E->fd);
+
+	for (i = 0; i < EVLOG_BUFFERS; i++) {
+		E->buffers[i] = (struct event_record *)malloc(EVLOG_BUFFER_RECORDS * sizeof(struct event_record));
+		if (!E->buffers[i]) {
+			fprintf(stdout, "** event log buffers not allocated\n");
+			exit(-1);
+		}
+	}
+	pthread_mutex_init(&E->lock, NULL);
+	pthread_cond_init(&E->filled, NULL);
+	pthread_cond_init(&E->drained, NULL);
+	pthread_create(&E->writer, NULL, event_log_write, E);
+
+	return E;
+}
+
+// Hands the current buffer to the writer and waits until the next one is free
+void event_log_flush(struct event_log_t *E)
+{
+	if (!E->n) return;
+
+	pthread_mutex_lock(&E->lock);
+	E->counts[E->current] = E->n;
+	E->full[E->current] = 1;
+	pthread_cond_signal(&E->filled);
+	E->current = (E->current + 1) % EVLOG_BUFFERS;
+	while (E->full[E->current]) {
+		pthread_cond_wait(&E->drained, &E->lock);
+	}
+	pthread_mutex_unlock(&E->lock);
+	E->n = 0;
+}
+
+// Logs the access cache_access just performed on cp; status is what it returned
+void event_log_record(struct event_log_t *E, struct cache_t *cp, unsigned long address, char access_type, int status)
+{
+	struct event_record *r = &E->buffers[E->current][E->n];
+	unsigned long tag, set;
+
+	cache_decompose(cp, address, &tag, &set);
+	r->address = address;
+	r->tag = tag;
+	r->set = (unsigned int)set;
+	r->type = (unsigned char)access_type;
+	r->outcome = (unsigned char)status;
+	r->victim = (status != 0) ? (unsigned char)cp->evicted : 0;
+	r->victim_address = r->victim ? cp->evicted_address : 0;
+	r->pad = 0;
+
+	E->records++;
+	E->n++;
+	if (E->n == EVLOG_BUFFER_RECORDS) {
+		event_log_flush(E);
+	}
+}
+
+// Writes out everything still buffered, stops the writer and closes the file
+void event_log_close(struct event_log_t *E)
+{
+	int i;
+
+	event_log_flush(E);
+
+	pthread_mutex_lock(&E->lock);
+	E->stop = 1;
+	pthread_cond_signal(&E->filled);
+	pthread_mutex_unlock(&E->lock);
+	pthread_join(E->writer, NULL);
+
+	for (i = 0; i < EVLOG_BUFFERS; i++) {
+		free(E->buffers[i]);
+	}
+	pthread_mutex_destroy(&E->lock);
+	pthread_cond_destroy(&E->filled);
+	pthread_cond_destroy(&E->drained);
+	fclose(E->fd);
+	free(E);
+}
+
+#endif
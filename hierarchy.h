@@ -0,0 +1,463 @@
+#ifndef __HIERARCHY_H__
+#define __HIERARCHY_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Multi-level cache hierarchy built from cache_t instances.
+//
+// The configuration file has one level per line, top level first:
+//     <name> <cache size KB> <block size> <associativity> <replacement policy>
+// where name is L1I, L1D or L1 (unified) for the first level and L2, L3, ... below it,
+// plus an optional line selecting how the levels share blocks:
+//     inclusion nine | inclusive | exclusive
+//
+// A level line may end with its hit latency in cycles. A memory line turns on the
+// timing model (timing.h), with MSHRs on the L1 data side:
+//     memory <latency> [<mshrs>]
+//
+// With an L1I (or a unified L1) every trace item is also an instruction fetch at its
+// PC; with only an L1D just the loads and stores are simulated.
+//
+//   nine      - non-inclusive non-exclusive: every level on a miss path is filled
+//               and evicts on its own
+//   inclusive - a block evicted from a lower level is also invalidated above it
+//               (back-invalidation); dirty copies found above are written back with it
+//   exclusive - a block lives in exactly one level: lower-level hits move the block up,
+//               memory fills go only to the first level, and the first level's victims,
+//               clean or dirty, drop into the next level (all block sizes must match)
+//
+// Dirty victims (cache_access returning 2) are written back to the next level, and
+// from the last level to memory. A writeback carries the whole block, so it reads
+// nothing from below: a level that has the block marks it dirty, a level that does
+// not passes the write around itself to the level after it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "timing.h"
+
+#define HIER_MAX_LEVELS 8
+#define HIER_DEFAULT_MSHRS 8
+#define HIER_LINE_MAX 256
+
+enum hier_inclusion {
+	HIER_NINE,
+	HIER_INCLUSIVE,
+	HIER_EXCLUSIVE
+};
+
+char *hier_inclusion_names[] = { "NINE", "INCLUSIVE", "EXCLUSIVE" };
+
+struct hier_level {
+	char name[8];
+	int depth;              // 1 for L1I/L1D/L1, 2 for L2, ...
+	int next;               // index of the level misses go to, -1 for memory
+	int cache_size;
+	int block_size;
+	int associativity;
+	int replacement_policy;
+	int latency;            // hit latency in cycles
+	struct cache_t *cp;
+
+	// statistics for this level only
+	unsigned long long accesses;
+	unsigned long long read_accesses;
+	unsigned long long write_accesses;   // stores and writebacks from above
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long writebacks;       // dirty blocks this level sent down
+	unsigned long long back_invalidations; // blocks removed above it (inclusive)
+};
+
+struct hierarchy_t {
+	enum hier_inclusion inclusion;
+	int nlevels;
+	struct hier_level levels[HIER_MAX_LEVELS];
+	int l1i;                // level for instruction fetches, -1 if they are not simulated
+	int l1d;                // level for loads and stores
+	unsigned long long clock;
+	unsigned long long memory_reads;   // blocks fetched from memory
+	unsigned long long memory_writes;  // blocks written back to memory
+
+	int memory_latency;
+	struct timing_t *timing;           // NULL unless the file has a memory line
+};
+
+// Reads the configuration file. Returns NULL on a bad file.
+struct hierarchy_t * hierarchy_create(char *config_file_name)
+{
+	FILE *config_fd;
+	char line[HIER_LINE_MAX], name[16], word[16];
+	int line_number = 0, i, j, n, mshrs = 0;
+	struct hier_level *L;
+	struct hierarchy_t *H;
+
+	config_fd = fopen(config_file_name, "r");
+	if (!config_fd) {
+		fprintf(stdout, "\nhierarchy file %s not opened.\n", config_file_name);
+		return NULL;
+	}
+
+	H = (struct hierarchy_t *)calloc(1, sizeof(struct hierarchy_t));
+	H->l1i = -1;
+	H->l1d = -1;
+
+	while (fgets(line, sizeof(line), config_fd)) {
+		char *p = line;
+		line_number++;
+
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+		if (sscanf(p, "inclusion %15s", word) == 1) {
+			if (strcmp(word, "nine") == 0) H->inclusion = HIER_NINE;
+			else if (strcmp(word, "inclusive") == 0) H->inclusion = HIER_INCLUSIVE;
+			else if (strcmp(word, "exclusive") == 0) H->inclusion = HIER_EXCLUSIVE;
+			else {
+				fprintf(stdout, "\n%s:%d: inclusion has to be nine, inclusive or exclusive.\n", config_file_name, line_number);
+				fclose(config_fd);
+				return NULL;
+			}
+			continue;
+		}
+
+		n = sscanf(p, "memory %d %d", &H->memory_latency, &mshrs);
+		if (n >= 1) {
+			if (n == 1) mshrs = HIER_DEFAULT_MSHRS;
+			if (H->memory_latency < 0 || mshrs <= 0) {
+				fprintf(stdout, "\n%s:%d: expected memory <latency> [<mshrs>]\n", config_file_name, line_number);
+				fclose(config_fd);
+				return NULL;
+			}
+			continue;
+		}
+
+		if (H->nlevels == HIER_MAX_LEVELS) {
+			fprintf(stdout, "\n%s:%d: at most %d levels are supported.\n", config_file_name, line_number, HIER_MAX_LEVELS);
+			fclose(config_fd);
+			return NULL;
+		}
+		L = &H->levels[H->nlevels];
+		L->latency = 1;
+		if (sscanf(p, "%15s %d %d %d %d %d", name, &L->cache_size, &L->block_size, &L->associativity, &L->replacement_policy, &L->latency) < 5
+			|| L->latency < 0 || name[0] != 'L' || name[1] < '1' || name[1] > '9' || strlen(name) > 3) {
+			fprintf(stdout, "\n%s:%d: expected <L1I|L1D|L1|L2|...> <cache size> <block size> <associativity> <replacement policy> [<latency>]\n", config_file_name, line_number);
+			fclose(config_fd);
+			return NULL;
+		}
+		if (L->cache_size <= 0 || L->block_size <= 0 || L->associativity <= 0
+			|| (L->cache_size != (L->cache_size & -L->cache_size))
+			|| (L->block_size != (L->block_size & -L->block_size))
+			|| (L->associativity != (L->associativity & -L->associativity))) {
+			fprintf(stdout, "\n%s:%d: cache size, block size, and block associativity have to be a power of 2.\n", config_file_name, line_number);
+			fclose(config_fd);
+			return NULL;
+		}
+		if (!(L->replacement_policy >= 0 && L->replacement_policy < CACHE_NPOLICIES_ONLINE)) {
+			fprintf(stdout, "\n%s:%d: pick a replacement policy from 0 to %d (OPT only runs as a single cache).\n", config_file_name, line_number, CACHE_NPOLICIES_ONLINE - 1);
+			fclose(config_fd);
+			return NULL;
+		}
+
+		strcpy(L->name, name);
+		L->depth = name[1] - '0';
+		if (L->depth == 1) {
+			if (strcmp(name, "L1I") == 0) H->l1i = H->nlevels;
+			else if (strcmp(name, "L1D") == 0) H->l1d = H->nlevels;
+			else if (strcmp(name, "L1") == 0) H->l1i = H->l1d = H->nlevels;
+			else L->depth = 0;
+		}
+		else if (name[2] != '\0') {
+			L->depth = 0;
+		}
+		if (L->depth == 0) {
+			fprintf(stdout, "\n%s:%d: level has to be L1I, L1D, L1, L2, L3, ...\n", config_file_name, line_number);
+			fclose(config_fd);
+			return NULL;
+		}
+		L->cp = cache_create(L->cache_size, L->block_size, L->associativity, (enum cache_policy)L->replacement_policy);
+		H->nlevels++;
+	}
+	fclose(config_fd);
+
+	if (H->l1d < 0) {
+		fprintf(stdout, "\nhierarchy file %s needs an L1D or unified L1.\n", config_file_name);
+		return NULL;
+	}
+
+	// every level misses into the first level one deeper; levels have to be listed in order
+	for (i = 0; i < H->nlevels; i++) {
+		L = &H->levels[i];
+		L->next = -1;
+		for (j = i + 1; j < H->nlevels; j++) {
+			if (H->levels[j].depth == L->depth + 1) {
+				L->next = j;
+				break;
+			}
+		}
+		if (i > 0 && L->depth != 1 && L->depth != H->levels[i - 1].depth + 1) {
+			fprintf(stdout, "\nhierarchy file %s: %s has to follow L%d.\n", config_file_name, L->name, L->depth - 1);
+			return NULL;
+		}
+		if (L->next >= 0 && H->levels[L->next].block_size < L->block_size) {
+			fprintf(stdout, "\nhierarchy file %s: %s cannot have smaller blocks than the level above it.\n", config_file_name, H->levels[L->next].name);
+			return NULL;
+		}
+		if (H->inclusion == HIER_EXCLUSIVE && L->block_size != H->levels[0].block_size) {
+			fprintf(stdout, "\nhierarchy file %s: an exclusive hierarchy needs one block size.\n", config_file_name);
+			return NULL;
+		}
+	}
+
+	if (mshrs) {
+		H->timing = timing_create(mshrs, H->levels[H->l1d].cp->n_bits_for_block_offset);
+	}
+
+	return H;
+}
+
+unsigned int hierarchy_access(struct hierarchy_t *H, int l, unsigned long address, char access_type);
+
+// Writes a dirty block from the level above into level l: a hit marks it dirty there,
+// a miss goes around level l without allocating (nothing is fetched for a full block)
+void hierarchy_writeback(struct hierarchy_t *H, int l, unsigned long long address)
+{
+	struct hier_level *L;
+
+	if (l < 0) {
+		H->memory_writes++;
+		return;
+	}
+
+	L = &H->levels[l];
+	L->accesses++;
+	L->write_accesses++;
+	if (cache_probe(L->cp, address)) {
+		H->clock++;
+		cache_access(L->cp, address, ti_STORE, NULL, 0, H->clock);
+		L->hits++;
+		return;
+	}
+	L->misses++;
+	hierarchy_writeback(H, L->next, address);
+}
+
+// Inclusive: removes every copy of the block at address from the levels above level l.
+// Returns 1 if one of the removed copies was dirty.
+int hierarchy_back_invalidate(struct hierarchy_t *H, int l, unsigned long long address)
+{
+	struct hier_level *L = &H->levels[l];
+	unsigned long long offset, base = address & ~(unsigned long long)(L->block_size - 1);
+	int u, dirty = 0;
+
+	for (u = 0; u < H->nlevels; u++) {
+		struct hier_level *U = &H->levels[u];
+		if (U->depth >= L->depth) continue;
+
+		// an upper level with smaller blocks can hold several pieces of the block
+		for (offset = 0; offset < (unsigned long long)L->block_size; offset += U->block_size) {
+			int status = cache_invalidate(U->cp, base + offset);
+			if (status) {
+				L->back_invalidations++;
+			}
+			if (status == 2) {
+				dirty = 1;
+			}
+		}
+	}
+
+	return dirty;
+}
+
+// Handles the block level l just replaced (if any) according to the inclusion policy
+void hierarchy_evict(struct hierarchy_t *H, int l, int evicted, unsigned long long evicted_address)
+{
+	struct hier_level *L = &H->levels[l];
+
+	if (!evicted) return;
+
+	if (H->inclusion == HIER_INCLUSIVE && hierarchy_back_invalidate(H, l, evicted_address)) {
+		evicted = 2; // the newest data was above, it leaves with this eviction
+	}
+
+	if (evicted == 2) {
+		L->writebacks++;
+		hierarchy_writeback(H, L->next, evicted_address);
+	}
+}
+
+// Exclusive: looks for the block below level l and moves it up out of the level that has it.
+// Returns 2 if the block was dirty there, 1 otherwise; the cycles spent are added to latency.
+int hierarchy_exclusive_fetch(struct hierarchy_t *H, int l, unsigned long address, unsigned int *latency)
+{
+	struct hier_level *L;
+	int status;
+
+	if (l < 0) {
+		H->memory_reads++;
+		*latency += H->memory_latency;
+		return 1;
+	}
+
+	L = &H->levels[l];
+	L->accesses++;
+	L->read_accesses++;
+	*latency += L->latency;
+	status = cache_invalidate(L->cp, address);
+	if (status) {
+		L->hits++;
+		return status;
+	}
+	L->misses++;
+	return hierarchy_exclusive_fetch(H, L->next, address, latency);
+}
+
+// Exclusive: places a victim from the level above into level l, pushing its own victim further down
+void hierarchy_exclusive_insert(struct hierarchy_t *H, int l, unsigned long long address, int dirty)
+{
+	struct hier_level *L;
+
+	if (l < 0) {
+		if (dirty) H->memory_writes++;
+		return;
+	}
+
+	L = &H->levels[l];
+	H->clock++;
+	cache_access(L->cp, address, dirty ? ti_STORE : ti_LOAD, NULL, 0, H->clock);
+	if (L->cp->evicted) {
+		if (L->cp->evicted == 2) L->writebacks++;
+		hierarchy_exclusive_insert(H, L->next, L->cp->evicted_address, L->cp->evicted == 2);
+	}
+}
+
+// Accesses level l; misses are filled from the levels below it.
+// Returns the latency of the access: the hit latency of every level looked in, plus memory.
+unsigned int hierarchy_access(struct hierarchy_t *H, int l, unsigned long address, char access_type)
+{
+	struct hier_level *L = &H->levels[l];
+	unsigned long long evicted_address;
+	unsigned int latency = L->latency;
+	int status, evicted;
+
+	L->accesses++;
+	if (access_type == ti_STORE) {
+		L->write_accesses++;
+	}
+	else {
+		L->read_accesses++;
+	}
+
+	H->clock++;
+	status = cache_access(L->cp, address, access_type, NULL, 0, H->clock);
+	if (status == 0) {
+		L->hits++;
+		return latency;
+	}
+	L->misses++;
+
+	// the lower levels below may replace blocks in this cache too, so keep our victim
+	evicted = L->cp->evicted;
+	evicted_address = L->cp->evicted_address;
+
+	if (H->inclusion == HIER_EXCLUSIVE) {
+		if (hierarchy_exclusive_fetch(H, L->next, address, &latency) == 2) {
+			cache_set_dirty(L->cp, address);
+		}
+		if (evicted == 2) L->writebacks++;
+		if (evicted) {
+			hierarchy_exclusive_insert(H, L->next, evicted_address, evicted == 2);
+		}
+		return latency;
+	}
+
+	// fetch the block, then write back the victim (off the critical path)
+	if (L->next >= 0) {
+		latency += hierarchy_access(H, L->next, address, ti_LOAD);
+	}
+	else {
+		H->memory_reads++;
+		latency += H->memory_latency;
+	}
+	hierarchy_evict(H, l, evicted, evicted_address);
+	return latency;
+}
+
+// Feeds one trace item to the hierarchy: an instruction fetch at PC (if modeled) and its data access
+// With the timing model, the data access is timed; instruction fetches are not.
+void hierarchy_trace_item(struct hierarchy_t *H, const struct trace_item *tr_entry)
+{
+	unsigned long long l1d_misses;
+	unsigned int latency;
+
+	if (H->timing) {
+		timing_tick(H->timing);
+	}
+	if (H->l1i >= 0) {
+		hierarchy_access(H, H->l1i, tr_entry->PC, ti_LOAD);
+	}
+	if (tr_entry->type == ti_LOAD || tr_entry->type == ti_STORE) {
+		l1d_misses = H->levels[H->l1d].misses;
+		latency = hierarchy_access(H, H->l1d, tr_entry->Addr, tr_entry->type);
+		if (H->timing) {
+			timing_access(H->timing, tr_entry->Addr, H->levels[H->l1d].misses != l1d_misses, latency);
+		}
+	}
+}
+
+void hierarchy_print_results(struct hierarchy_t *H, char *trace_file_name, FILE *file_results)
+{
+	int i;
+	struct hier_level *L;
+
+	printf("\n\nParameters:");
+	fprintf(file_results, "\n\nParameters:");
+	printf("\nTrace Name: %s", trace_file_name);
+	fprintf(file_results, "\nTrace Name: %s", trace_file_name);
+	printf("\nInclusion: %s", hier_inclusion_names[H->inclusion]);
+	fprintf(file_results, "\nInclusion: %s", hier_inclusion_names[H->inclusion]);
+
+	for (i = 0; i < H->nlevels; i++) {
+		L = &H->levels[i];
+
+		printf("\n\n%s: %d KBYTES, %d BYTES blocks, %d-way, %s", L->name, L->cache_size, L->block_size, L->associativity, cache_policy_names[L->replacement_policy]);
+		fprintf(file_results, "\n\n%s: %d KBYTES, %d BYTES blocks, %d-way, %s", L->name, L->cache_size, L->block_size, L->associativity, cache_policy_names[L->replacement_policy]);
+		if (H->timing) {
+			printf(", %d cycles", L->latency);
+			fprintf(file_results, ", %d cycles", L->latency);
+		}
+		printf("\n%s Accesses: %llu", L->name, L->accesses);
+		fprintf(file_results, "\n%s Accesses: %llu", L->name, L->accesses);
+		printf("\n%s Read Accesses: %llu", L->name, L->read_accesses);
+		fprintf(file_results, "\n%s Read Accesses: %llu", L->name, L->read_accesses);
+		printf("\n%s Write Accesses: %llu", L->name, L->write_accesses);
+		fprintf(file_results, "\n%s Write Accesses: %llu", L->name, L->write_accesses);
+		printf("\n%s Hits: %llu", L->name, L->hits);
+		fprintf(file_results, "\n%s Hits: %llu", L->name, L->hits);
+		printf("\n%s Misses: %llu", L->name, L->misses);
+		fprintf(file_results, "\n%s Misses: %llu", L->name, L->misses);
+		printf("\n%s Writebacks: %llu", L->name, L->writebacks);
+		fprintf(file_results, "\n%s Writebacks: %llu", L->name, L->writebacks);
+		if (H->inclusion == HIER_INCLUSIVE && L->depth > 1) {
+			printf("\n%s Back Invalidations: %llu", L->name, L->back_invalidations);
+			fprintf(file_results, "\n%s Back Invalidations: %llu", L->name, L->back_invalidations);
+		}
+	}
+
+	printf("\n\nMemory Reads: %llu", H->memory_reads);
+	fprintf(file_results, "\n\nMemory Reads: %llu", H->memory_reads);
+	printf("\nMemory Writes: %llu", H->memory_writes);
+	fprintf(file_results, "\nMemory Writes: %llu", H->memory_writes);
+
+	if (H->timing) {
+		printf("\nMemory Latency: %d cycles", H->memory_latency);
+		fprintf(file_results, "\nMemory Latency: %d cycles", H->memory_latency);
+		timing_print_results(H->timing, file_results);
+	}
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef __MATTSON_H__
+#define __MATTSON_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Mattson stack-distance analysis for LRU caches.
+// LRU has the inclusion property: a reference hits in an A-way set if and only if
+// fewer than A distinct blocks of that set were touched since its last use. So one
+// histogram of per-set reuse distances gives the miss count of every associativity
+// for that number of sets, and one histogram per set count gives the whole curve.
+//
+// Distances are counted with a Fenwick tree per set indexed by (set-local) access
+// time: every block keeps one marker at the time of its most recent access, and the
+// distance of a reuse is the number of markers newer than the block's own. The
+// time axis is compacted whenever it fills up, so memory stays proportional to the
+// number of distinct blocks and not to the trace length.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+
+#define MATTSON_EMPTY 0xffffffffu
+#define MATTSON_INITIAL_SET_CAP 8
+
+struct mattson_set {
+	unsigned int clock;   // next free time position (positions start at 1)
+	unsigned int cap;     // last usable time position
+	unsigned int live;    // number of blocks with a marker in this set
+	unsigned int *tree;   // Fenwick tree over time positions 1..cap
+	unsigned int *owner;  // block id holding the marker at each position
+};
+
+struct mattson_level {
+	int nsets;
+	int max_distance;            // blocks per set in the largest cache analyzed
+	struct mattson_set *sets;
+	unsigned int *last;          // time position of each block's last access, 0 if never seen
+	unsigned long long *hist;    // hist[d] = reuses at distance d, hist[max_distance] = farther or cold
+};
+
+struct mattson_t {
+	int bsize;
+	int n_bits_for_block_offset;
+	int max_blocks;              // blocks in the largest cache analyzed
+	int nlevels;                 // set counts 1, 2, 4, ..., max_blocks
+	struct mattson_level *levels;
+
+	// block address -> dense block id, open addressing
+	unsigned long *hash_keys;    // block address + 1, 0 marks an empty slot
+	unsigned int *hash_ids;
+	unsigned int hash_cap;
+	unsigned int nblocks;
+	unsigned int last_cap;       // allocated length of every level's last[]
+
+	unsigned long long accesses;
+};
+
+struct mattson_t * mattson_create(int blocksize, int max_size)
+{
+	int i, j;
+	struct mattson_t *M = (struct mattson_t *)calloc(1, sizeof(struct mattson_t));
+
+	M->bsize = blocksize;
+	while ((1 << M->n_bits_for_block_offset) < blocksize) {
+		M->n_bits_for_block_offset++;
+	}
+	M->max_blocks = (max_size * 1024) / blocksize;
+	if (M->max_blocks < 1) {
+		M->max_blocks = 1;
+	}
+
+	M->nlevels = 0;
+	for (i = 1; i <= M->max_blocks; i = i * 2) {
+		M->nlevels++;
+	}
+
+	M->hash_cap = 1024;
+	M->hash_keys = (unsigned long *)calloc(M->hash_cap, sizeof(unsigned long));
+	M->hash_ids = (unsigned int *)calloc(M->hash_cap, sizeof(unsigned int));
+	M->last_cap = 512;
+
+	M->levels = (struct mattson_level *)calloc(M->nlevels, sizeof(struct mattson_level));
+	for (i = 0; i < M->nlevels; i++) {
+		struct mattson_level *L = &M->levels[i];
+
+		L->nsets = 1 << i;
+		L->max_distance = M->max_blocks / L->nsets;
+		L->hist = (unsigned long long *)calloc(L->max_distance + 1, sizeof(unsigned long long));
+		L->last = (unsigned int *)calloc(M->last_cap, sizeof(unsigned int));
+		L->sets = (struct mattson_set *)calloc(L->nsets, sizeof(struct mattson_set));
+		for (j = 0; j < L->nsets; j++) {
+			L->sets[j].clock = 1;
+			L->sets[j].cap = MATTSON_INITIAL_SET_CAP;
+			L->sets[j].tree = (unsigned int *)calloc(MATTSON_INITIAL_SET_CAP + 1, sizeof(unsigned int));
+			L->sets[j].owner = (unsigned int *)malloc((MATTSON_INITIAL_SET_CAP + 1) * sizeof(unsigned int));
+		}
+	}
+
+	return M;
+}
+
+// Returns the dense id of a block, giving it a new id (and room in every last[]) the first time it is seen.
+unsigned int mattson_block_id(struct mattson_t *M, unsigned long block)
+{
+	unsigned int h, i, id;
+
+	h = (unsigned int)((block * 0x9E3779B97F4A7C15ull) >> 32) & (M->hash_cap - 1);
+	while (M->hash_keys[h]) {
+		if (M->hash_keys[h] == block + 1) {
+			return M->hash_ids[h];
+		}
+		h = (h + 1) & (M->hash_cap - 1);
+	}
+
+	id = M->nblocks;
+	M->nblocks++;
+	M->hash_keys[h] = block + 1;
+	M->hash_ids[h] = id;
+
+	if (M->nblocks == M->last_cap) {
+		int l;
+		for (l = 0; l < M->nlevels; l++) {
+			M->levels[l].last = (unsigned int *)realloc(M->levels[l].last, 2 * M->last_cap * sizeof(unsigned int));
+			memset(M->levels[l].last + M->last_cap, 0, M->last_cap * sizeof(unsigned int));
+		}
+		M->last_cap = M->last_cap * 2;
+	}
+
+	// keep the table at most half full
+	if (M->nblocks * 2 > M->hash_cap) {
+		unsigned int old_cap = M->hash_cap;
+		unsigned long *old_keys = M->hash_keys;
+		unsigned int *old_ids = M->hash_ids;
+
+		M->hash_cap = M->hash_cap * 2;
+		M->hash_keys = (unsigned long *)calloc(M->hash_cap, sizeof(unsigned long));
+		M->hash_ids = (unsigned int *)calloc(M->hash_cap, sizeof(unsigned int));
+		for (i = 0; i < old_cap; i++) {
+			if (old_keys[i]) {
+				h = (unsigned int)(((old_keys[i] - 1) * 0x9E3779B97F4A7C15ull) >> 32) & (M->hash_cap - 1);
+				while (M->hash_keys[h]) {
+					h = (h + 1) & (M->hash_cap - 1);
+				}
+				M->hash_keys[h] = old_keys[i];
+				M->hash_ids[h] = old_ids[i];
+			}
+		}
+		free(old_keys);
+		free(old_ids);
+	}
+
+	return id;
+}
+
+void mattson_tree_add(struct mattson_set *s, unsigned int pos, int delta)
+{
+	for (; pos <= s->cap; pos += pos & -pos) {
+		s->tree[pos] += delta;
+	}
+}
+
+// Number of markers at positions 1..pos
+unsigned int mattson_tree_prefix(struct mattson_set *s, unsigned int pos)
+{
+	unsigned int sum = 0;
+	for (; pos > 0; pos -= pos & -pos) {
+		sum += s->tree[pos];
+	}
+	return sum;
+}
+
+// Renumbers the live markers of a set to 1..live (keeping their order) and grows it if it is over half full.
+void mattson_compact(struct mattson_level *L, struct mattson_set *s)
+{
+	unsigned int pos, count, next = 1, new_cap = s->cap;
+	unsigned int *owner;
+
+	while (s->live * 2 >= new_cap) {
+		new_cap = new_cap * 2;
+	}
+	owner = (unsigned int *)malloc((new_cap + 1) * sizeof(unsigned int));
+
+	for (pos = 1; pos < s->clock; pos++) {
+		if (s->owner[pos] != MATTSON_EMPTY) {
+			owner[next] = s->owner[pos];
+			L->last[owner[next]] = next;
+			next++;
+		}
+	}
+	free(s->owner);
+	s->owner = owner;
+	count = next - 1; // the block being accessed has no marker yet
+
+	// a Fenwick tree of ones at 1..count: node i covers (i - lowbit(i), i]
+	free(s->tree);
+	s->tree = (unsigned int *)malloc((new_cap + 1) * sizeof(unsigned int));
+	s->tree[0] = 0;
+	for (pos = 1; pos <= new_cap; pos++) {
+		unsigned int low = pos - (pos & -pos);
+		s->tree[pos] = (pos <= count) ? pos - low : (low < count ? count - low : 0);
+	}
+
+	s->cap = new_cap;
+	s->clock = next;
+}
+
+// Records one reference to address at every set count
+void mattson_access(struct mattson_t *M, unsigned long address)
+{
+	unsigned long block = address >> M->n_bits_for_block_offset;
+	unsigned int id = mattson_block_id(M, block);
+	int l;
+
+	M->accesses++;
+
+	for (l = 0; l < M->nlevels; l++) {
+		struct mattson_level *L = &M->levels[l];
+		struct mattson_set *s = &L->sets[block & (L->nsets - 1)];
+		unsigned int last = L->last[id];
+		unsigned int distance;
+
+		if (last) {
+			distance = s->live - mattson_tree_prefix(s, last);
+			mattson_tree_add(s, last, -1);
+			s->owner[last] = MATTSON_EMPTY;
+		}
+		else {
+			distance = L->max_distance; // cold
+			s->live++;
+		}
+		if (distance > (unsigned int)L->max_distance) {
+			distance = L->max_distance;
+		}
+		L->hist[distance]++;
+
+		if (s->clock > s->cap) {
+			mattson_compact(L, s);
+		}
+		s->owner[s->clock] = id;
+		mattson_tree_add(s, s->clock, 1);
+		L->last[id] = s->clock;
+		s->clock++;
+	}
+}
+
+// Prints the LRU miss count and ratio for every power-of-two cache size and associativity up to the maximum size.
+void mattson_print_results(struct mattson_t *M, char *trace_file_name, FILE *file_results)
+{
+	int l, assoc, d;
+	unsigned long long hits, misses;
+	double ratio;
+
+	printf("\n\nParameters:");
+	fprintf(file_results, "\n\nParameters:");
+	printf("\nTrace Name: %s", trace_file_name);
+	fprintf(file_results, "\nTrace Name: %s", trace_file_name);
+	printf("\nBlock Size: %d BYTES", M->bsize);
+	fprintf(file_results, "\nBlock Size: %d BYTES", M->bsize);
+	printf("\nMax Cache Size: %d KBYTES", M->max_blocks * M->bsize / 1024);
+	fprintf(file_results, "\nMax Cache Size: %d KBYTES", M->max_blocks * M->bsize / 1024);
+	printf("\nReplacement Policy: LRU");
+	fprintf(file_results, "\nReplacement Policy: LRU");
+
+	printf("\n\nResults:");
+	fprintf(file_results, "\n\nResults:");
+	printf("\nCache Accesses: %llu", M->accesses);
+	fprintf(file_results, "\nCache Accesses: %llu", M->accesses);
+	printf("\nDistinct Blocks: %u", M->nblocks);
+	fprintf(file_results, "\nDistinct Blocks: %u", M->nblocks);
+	printf("\n\n%12s %8s %12s %14s %10s", "Size(BYTES)", "Sets", "Assoc", "Misses", "MissRatio");
+	fprintf(file_results, "\n\n%12s %8s %12s %14s %10s", "Size(BYTES)", "Sets", "Assoc", "Misses", "MissRatio");
+
+	for (l = 0; l < M->nlevels; l++) {
+		struct mattson_level *L = &M->levels[l];
+
+		hits = 0;
+		d = 0;
+		for (assoc = 1; assoc <= L->max_distance; assoc = assoc * 2) {
+			for (; d < assoc; d++) {
+				hits += L->hist[d];
+			}
+			misses = M->accesses - hits;
+			ratio = M->accesses ? (double)misses / (double)M->accesses : 0.0;
+			printf("\n%12llu %8d %12d %14llu %10.6f", (unsigned long long)L->nsets * assoc * M->bsize, L->nsets, assoc, misses, ratio);
+			fprintf(file_results, "\n%12llu %8d %12d %14llu %10.6f", (unsigned long long)L->nsets * assoc * M->bsize, L->nsets, assoc, misses, ratio);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef __MISS_STREAM_H__
+#define __MISS_STREAM_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Miss-stream filtering.
+// Writes the traffic a cache sends to the level below it as a new trace, which
+// the simulator reads like any other, so the next level can be swept without
+// running this one again:
+//   - a miss that allocates becomes a ti_LOAD of the block (a fill)
+//   - a dirty victim becomes a ti_STORE of its block, after the fill (as in hierarchy.h)
+//   - a store that goes to memory (any store under write-through, a store miss under
+//     no-write-allocate) becomes a ti_STORE of its address
+// Records keep the PC of the access that caused them. A file name ending in .mtr
+// gets the compact format (compact_trace.h, with PCs), anything else raw trace_items.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "compact_trace.h"
+
+#define MISS_STREAM_BUFFER 4096   // raw records written per fwrite
+
+struct miss_stream_t {
+	struct cache_t *cp;
+	char *file_name;
+	FILE *fd;                     // raw output
+	struct mtr_writer *mtr;       // compact output
+	struct trace_item *buffer;
+	int n;
+
+	unsigned long long fills;
+	unsigned long long writebacks;
+	unsigned long long stores;    // stores written through or around the cache
+	unsigned long long bytes;     // size of the finished file
+};
+
+// Opens file_name for the miss stream of cp. Returns NULL if it cannot be created.
+struct miss_stream_t * miss_stream_open(struct cache_t *cp, char *file_name)
+{
+	struct miss_stream_t *M = (struct miss_stream_t *)calloc(1, sizeof(struct miss_stream_t));
+	size_t len = strlen(file_name);
+
+	M->cp = cp;
+	M->file_name = file_name;
+	if (len > 4 && strcmp(file_name + len - 4, ".mtr") == 0) {
+		M->mtr = mtr_writer_open(file_name, MTR_FLAG_PC);
+		if (!M->mtr) {
+			free(M);
+			return NULL;
+		}
+	}
+	else {
+		M->fd = fopen(file_name, "wb");
+		if (!M->fd) {
+			free(M);
+			return NULL;
+		}
+		M->buffer = (struct trace_item *)malloc(MISS_STREAM_BUFFER * sizeof(struct trace_item));
+	}
+	return M;
+}
+
+void miss_stream_emit(struct miss_stream_t *M, unsigned char type, unsigned int address, unsigned int pc)
+{
+	struct trace_item item;
+
+	memset(&item, 0, sizeof(item));
+	item.type = type;
+	item.PC = pc;
+	item.Addr = address;
+	if (M->mtr) {
+		mtr_writer_add(M->mtr, &item);
+		return;
+	}
+	M->buffer[M->n] = item;
+	M->n++;
+	if (M->n == MISS_STREAM_BUFFER) {
+		fwrite(M->buffer, sizeof(struct trace_item), M->n, M->fd);
+		M->n = 0;
+	}
+}
+
+// Writes the traffic of the access cache_access just performed; status is what it returned
+void miss_stream_access(struct miss_stream_t *M, const struct trace_item *item, int status)
+{
+	struct cache_t *cp = M->cp;
+	int allocated = !(item->type == ti_STORE && cp->no_write_allocate);
+
+	if (status == 1 || status == 2) {
+		if (allocated) {
+			miss_stream_emit(M, ti_LOAD, item->Addr & ~(unsigned int)(cp->bsize - 1), item->PC);
+			M->fills++;
+		}
+		if (cp->evicted == 2) {
+			miss_stream_emit(M, ti_STORE, (unsigned int)cp->evicted_address, item->PC);
+			M->writebacks++;
+		}
+	}
+	if (item->type == ti_STORE && (cp->write_through || (status != 0 && !allocated))) {
+		miss_stream_emit(M, ti_STORE, item->Addr, item->PC);
+		M->stores++;
+	}
+}
+
+// Finishes the file
+void miss_stream_close(struct miss_stream_t *M)
+{
+	if (M->mtr) {
+		M->bytes = mtr_writer_close(M->mtr);
+		M->mtr = NULL;
+		return;
+	}
+	if (M->n) {
+		fwrite(M->buffer, sizeof(struct trace_item), M->n, M->fd);
+		M->n = 0;
+	}
+	M->bytes = (unsigned long long)ftello(M->fd);
+	fclose(M->fd);
+	free(M->buffer);
+	M->fd = NULL;
+}
+
+// Closes the stream and reports it against the records read from the input trace
+void miss_stream_print_results(struct miss_stream_t *M, unsigned long long input_records, FILE *file_results)
+{
+	unsigned long long records = M->fills + M->writebacks + M->stores;
+
+	miss_stream_close(M);
+
+	printf("\n\nMiss Stream: %s", M->file_name);
+	fprintf(file_results, "\n\nMiss Stream: %s", M->file_name);
+	printf("\nMiss Stream Records: %llu (%llu fills, %llu writebacks, %llu stores)", records, M->fills, M->writebacks, M->stores);
+	fprintf(file_results, "\nMiss Stream Records: %llu (%llu fills, %llu writebacks, %llu stores)", records, M->fills, M->writebacks, M->stores);
+	printf("\nMiss Stream Size: %llu BYTES, %.1fx fewer records than the input", M->bytes, records ? (double)input_records / (double)records : 0.0);
+	fprintf(file_results, "\nMiss Stream Size: %llu BYTES, %.1fx fewer records than the input", M->bytes, records ? (double)input_records / (double)records : 0.0);
+}
+
+#endif
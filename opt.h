@@ -0,0 +1,200 @@
+#ifndef __OPT_H__
+#define __OPT_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Next-use pre-pass for OPT (Belady's MIN) replacement.
+// Before an OPT run the trace is read once on its own reader. Every load/store gets
+// the distance, in loads/stores, to the next access to the same block; the cache
+// then looks the distance up by its logical clock (cache_next_use in skeleton.h).
+//
+// The pass goes forward: a hash table maps each block to the position of its last
+// access, and when the block comes up again the distance is written back into that
+// position. Distances are 32 bits, 0 meaning the block is not accessed again (a
+// distance beyond 2^32 - 1 accesses is recorded as 0 as well). The array lives in
+// an unlinked temporary file that is memory-mapped and grown as the pass goes, so
+// its size is bounded by the disk, not by RAM; only the last-position table, one
+// entry per distinct block, is held in memory, and it is freed when the pass ends.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "trace_reader.h"
+
+#define OPT_INITIAL_ACCESSES (1ULL << 20)
+
+struct opt_t {
+	FILE *fd;                  // temporary file backing next_use
+	unsigned int *next_use;
+	unsigned long long count;     // accesses in the pass
+	unsigned long long capacity;  // accesses the file has room for
+
+	// last access of every block, open addressing
+	unsigned long long *last_keys;   // block address + 1, 0 marks an empty slot
+	unsigned long long *last_positions;
+	unsigned long long last_cap;
+	unsigned long long blocks;       // distinct blocks
+};
+
+// Maps (or remaps) the file at capacity accesses. Returns 0 if the file cannot grow.
+int opt_map(struct opt_t *O, unsigned long long capacity)
+{
+	if (O->next_use) {
+		munmap(O->next_use, O->capacity * sizeof(unsigned int));
+		O->next_use = NULL;
+	}
+	if (ftruncate(fileno(O->fd), (off_t)(capacity * sizeof(unsigned int))) != 0) {
+		return 0;
+	}
+	O->next_use = (unsigned int *)mmap(NULL, capacity * sizeof(unsigned int), PROT_READ | PROT_WRITE, MAP_SHARED, fileno(O->fd), 0);
+	if (O->next_use == MAP_FAILED) {
+		O->next_use = NULL;
+		return 0;
+	}
+	O->capacity = capacity;
+	return 1;
+}
+
+static inline unsigned long long opt_hash(unsigned long long block)
+{
+	return (block * 0x9E3779B97F4A7C15ull) >> 20;
+}
+
+// Returns the slot of block in the last-position table, growing it to stay at most half full
+unsigned long long opt_slot(struct opt_t *O, unsigned long long block)
+{
+	unsigned long long h, i, old_cap;
+	unsigned long long *old_keys, *old_positions;
+
+	if ((O->blocks + 1) * 2 > O->last_cap) {
+		old_cap = O->last_cap;
+		old_keys = O->last_keys;
+		old_positions = O->last_positions;
+
+		O->last_cap = old_cap * 2;
+		O->last_keys = (unsigned long long *)calloc(O->last_cap, sizeof(unsigned long long));
+		O->last_positions = (unsigned long long *)malloc(O->last_cap * sizeof(unsigned long long));
+		for (i = 0; i < old_cap; i++) {
+			if (old_keys[i]) {
+				h = opt_hash(old_keys[i] - 1) & (O->last_cap - 1);
+				while (O->last_keys[h]) {
+					h = (h + 1) & (O->last_cap - 1);
+				}
+				O->last_keys[h] = old_keys[i];
+				O->last_positions[h] = old_positions[i];
+			}
+		}
+		free(old_keys);
+		free(old_positions);
+	}
+
+	h = opt_hash(block) & (O->last_cap - 1);
+	while (O->last_keys[h] && O->last_keys[h] != block + 1) {
+		h = (h + 1) & (O->last_cap - 1);
+	}
+	return h;
+}
+
+void opt_close(struct opt_t *O);
+
+/*
+	Runs the pre-pass over trace_file_name for cp's block size and attaches the result to cp.
+	The pass skips the first skip_records records and stops after record_limit records
+	(0 for the end of the trace), so it covers the same loads and stores as the run.
+	Returns NULL (after a message, with everything released) if the trace or the temporary
+	file cannot be used, so a batch job can fail without ending the process.
+*/
+struct opt_t * opt_create(struct cache_t *cp, char *trace_file_name, enum trace_reader_mode mode,
+	unsigned long long skip_records, unsigned long long record_limit)
+{
+	struct opt_t *O;
+	struct trace_reader_t *R;
+	const struct trace_item *item;
+	unsigned long long records = 0, block, h, distance;
+
+	R = trace_reader_open(trace_file_name, mode);
+	if (!R) {
+		fprintf(stdout, "\ntrace file %s not opened for the OPT pre-pass.\n", trace_file_name);
+		return NULL;
+	}
+
+	O = (struct opt_t *)calloc(1, sizeof(struct opt_t));
+	O->fd = tmpfile();
+	if (!O->fd || !opt_map(O, OPT_INITIAL_ACCESSES)) {
+		fprintf(stdout, "\nOPT next-use file not created.\n");
+		trace_reader_close(R);
+		opt_close(O);
+		return NULL;
+	}
+	O->last_cap = 1024;
+	O->last_keys = (unsigned long long *)calloc(O->last_cap, sizeof(unsigned long long));
+	O->last_positions = (unsigned long long *)malloc(O->last_cap * sizeof(unsigned long long));
+
+	while ((!record_limit || records < record_limit) && trace_reader_next(R, &item)) {
+		records++;
+		if (records <= skip_records || (item->type != ti_LOAD && item->type != ti_STORE)) {
+			continue;
+		}
+
+		if (O->count == O->capacity && !opt_map(O, O->capacity * 2)) {
+			fprintf(stdout, "\nOPT next-use file cannot grow to %llu accesses.\n", O->capacity * 2);
+			trace_reader_close(R);
+			opt_close(O);
+			return NULL;
+		}
+
+		block = (unsigned long long)item->Addr >> cp->n_bits_for_block_offset;
+		h = opt_slot(O, block);
+		if (O->last_keys[h]) {
+			distance = O->count - O->last_positions[h];
+			O->next_use[O->last_positions[h]] = (distance <= 0xffffffffULL) ? (unsigned int)distance : 0;
+		}
+		else {
+			O->last_keys[h] = block + 1;
+			O->blocks++;
+		}
+		O->last_positions[h] = O->count;
+		O->next_use[O->count] = 0;
+		O->count++;
+	}
+	trace_reader_close(R);
+
+	free(O->last_keys);
+	free(O->last_positions);
+	O->last_keys = NULL;
+	O->last_positions = NULL;
+
+	// the run reads the array front to back
+	madvise(O->next_use, O->capacity * sizeof(unsigned int), MADV_SEQUENTIAL);
+	cp->next_use = O->next_use;
+	cp->next_use_count = O->count;
+	return O;
+}
+
+void opt_print_results(struct opt_t *O, FILE *file_results)
+{
+	printf("\nOPT Next-Use Pass: %llu accesses, %llu blocks", O->count, O->blocks);
+	fprintf(file_results, "\nOPT Next-Use Pass: %llu accesses, %llu blocks", O->count, O->blocks);
+}
+
+// Unmaps the array; the temporary file goes away when it is closed
+void opt_close(struct opt_t *O)
+{
+	if (O->next_use) {
+		munmap(O->next_use, O->capacity * sizeof(unsigned int));
+	}
+	if (O->fd) {
+		fclose(O->fd);
+	}
+	free(O->last_keys);
+	free(O->last_positions);
+	free(O);
+}
+
+#endif
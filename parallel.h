@@ -0,0 +1,226 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Set-partitioned parallel simulation of one cache.
+// The sets of a cache never interact, so each worker thread owns a contiguous range
+// of sets and simulates only the references that map there. The decoding thread
+// splits the tag/set of every load and store, stamps it with its position in the
+// trace (the logical clock) and appends it to the queue of the worker that owns the
+// set. Each set therefore sees the same references, in the same order and with the
+// same timestamps as in a serial run, and the merged counters are identical.
+//
+// RANDOM and BRRIP draw from one random generator shared by every set, which makes
+// their result depend on the global order of the references; parallel_supported
+// returns 0 for them and the caller stays on the serial path.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace_item.h"
+#include "skeleton.h"
+
+#define PARALLEL_QUEUE_CHUNKS 4
+#define PARALLEL_CHUNK_ITEMS 4096
+#define PARALLEL_MAX_WORKERS 256
+
+struct parallel_item {
+	unsigned long long now;  // logical time of the access
+	unsigned long tag;
+	unsigned int set;
+	unsigned char type;
+};
+
+struct parallel_chunk {
+	struct parallel_item *items;
+	int n_items;
+	int full;                // handed to the worker and not yet simulated
+};
+
+struct parallel_worker {
+	struct parallel_t *P;
+	pthread_t thread;
+	struct cache_t local;    // copy of the cache header; the arrays are shared, the sets are not
+
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+	struct parallel_chunk queue[PARALLEL_QUEUE_CHUNKS];
+	int head;                // chunk the decoder is filling
+	int stop;
+
+	// statistics of this worker's sets
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long misses_with_writeback;
+};
+
+struct parallel_t {
+	struct cache_t *cp;
+	int nworkers;
+	struct parallel_worker *workers;
+	unsigned long long clock;  // logical time of the last access handed out
+};
+
+// Returns 1 if cp can be simulated in parallel with the same results as serially
+int parallel_supported(struct cache_t *cp)
+{
+	return cp->policy != RANDOM && cp->policy != BRRIP;
+}
+
+void * parallel_work(void *arg)
+{
+	struct parallel_worker *W = (struct parallel_worker *)arg;
+	struct parallel_chunk *chunk;
+	unsigned long long counts[4] = { 0, 0, 0, 0 };
+	int tail = 0, i, r;
+
+	while (1) {
+		chunk = &W->queue[tail];
+		pthread_mutex_lock(&W->lock);
+		while (!chunk->full && !W->stop) {
+			pthread_cond_wait(&W->filled, &W->lock);
+		}
+		if (!chunk->full) {
+			// stopped and every chunk handed over has been simulated
+			pthread_mutex_unlock(&W->lock);
+			break;
+		}
+		pthread_mutex_unlock(&W->lock);
+
+		for (i = 0; i < chunk->n_items; i++) {
+			struct parallel_item *item = &chunk->items[i];
+			r = cache_access_block(&W->local, item->tag, item->set, item->type, item->now);
+			counts[r]++;
+		}
+
+		pthread_mutex_lock(&W->lock);
+		chunk->full = 0;
+		pthread_cond_signal(&W->drained);
+		pthread_mutex_unlock(&W->lock);
+		tail = (tail + 1) % PARALLEL_QUEUE_CHUNKS;
+	}
+
+	W->hits = counts[0];
+	W->misses = counts[1];
+	W->misses_with_writeback = counts[2];
+	return NULL;
+}
+
+// Starts up to nworkers threads (never more than the cache has sets) over the sets of cp
+struct parallel_t * parallel_create(struct cache_t *cp, int nworkers)
+{
+	struct parallel_t *P;
+	struct parallel_worker *W;
+	int i, j;
+
+	if (nworkers > cp->nsets) nworkers = cp->nsets;
+	if (nworkers > PARALLEL_MAX_WORKERS) nworkers = PARALLEL_MAX_WORKERS;
+	if (nworkers < 1) nworkers = 1;
+
+	P = (struct parallel_t *)calloc(1, sizeof(struct parallel_t));
+	P->cp = cp;
+	P->nworkers = nworkers;
+	P->workers = (struct parallel_worker *)calloc(nworkers, sizeof(struct parallel_worker));
+
+	for (i = 0; i < nworkers; i++) {
+		W = &P->workers[i];
+		W->P = P;
+		W->local = *cp;
+		for (j = 0; j < PARALLEL_QUEUE_CHUNKS; j++) {
+			W->queue[j].items = (struct parallel_item *)malloc(PARALLEL_CHUNK_ITEMS * sizeof(struct parallel_item));
+			if (!W->queue[j].items) {
+				fprintf(stdout, "** parallel queues not allocated\n");
+				exit(-1);
+			}
+		}
+		pthread_mutex_init(&W->lock, NULL);
+		pthread_cond_init(&W->filled, NULL);
+		pthread_cond_init(&W->drained, NULL);
+		pthread_create(&W->thread, NULL, parallel_work, W);
+	}
+
+	return P;
+}
+
+// Hands the chunk being filled to its worker and waits until the next one is free
+void parallel_hand_over(struct parallel_worker *W)
+{
+	pthread_mutex_lock(&W->lock);
+	W->queue[W->head].full = 1;
+	pthread_cond_signal(&W->filled);
+	W->head = (W->head + 1) % PARALLEL_QUEUE_CHUNKS;
+	while (W->queue[W->head].full) {
+		pthread_cond_wait(&W->drained, &W->lock);
+	}
+	pthread_mutex_unlock(&W->lock);
+	W->queue[W->head].n_items = 0;
+}
+
+// Queues one load or store for the worker that owns its set
+void parallel_access(struct parallel_t *P, unsigned long address, char access_type)
+{
+	struct cache_t *cp = P->cp;
+	struct parallel_worker *W;
+	struct parallel_chunk *chunk;
+	struct parallel_item *item;
+	unsigned long tag, set;
+
+	cache_decompose(cp, address, &tag, &set);
+	W = &P->workers[(set * P->nworkers) >> cp->n_bits_for_set_number];
+	chunk = &W->queue[W->head];
+	item = &chunk->items[chunk->n_items];
+
+	P->clock++;
+	item->now = P->clock;
+	item->tag = tag;
+	item->set = (unsigned int)set;
+	item->type = (unsigned char)access_type;
+
+	chunk->n_items++;
+	if (chunk->n_items == PARALLEL_CHUNK_ITEMS) {
+		parallel_hand_over(W);
+	}
+}
+
+// Simulates everything still queued, stops the workers and adds their counters to stats
+void parallel_finish(struct parallel_t *P, struct cache_batch_stats *stats)
+{
+	struct parallel_worker *W;
+	int i, j;
+
+	for (i = 0; i < P->nworkers; i++) {
+		W = &P->workers[i];
+		if (W->queue[W->head].n_items) {
+			parallel_hand_over(W);
+		}
+		pthread_mutex_lock(&W->lock);
+		W->stop = 1;
+		pthread_cond_signal(&W->filled);
+		pthread_mutex_unlock(&W->lock);
+	}
+
+	for (i = 0; i < P->nworkers; i++) {
+		W = &P->workers[i];
+		pthread_join(W->thread, NULL);
+		stats->hits += W->hits;
+		stats->misses += W->misses;
+		stats->misses_with_writeback += W->misses_with_writeback;
+
+		for (j = 0; j < PARALLEL_QUEUE_CHUNKS; j++) {
+			free(W->queue[j].items);
+		}
+		pthread_mutex_destroy(&W->lock);
+		pthread_cond_destroy(&W->filled);
+		pthread_cond_destroy(&W->drained);
+	}
+
+	free(P->workers);
+	free(P);
+}
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef __PREFETCH_H__
+#define __PREFETCH_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Hardware prefetcher models.
+// The prefetch stage looks at every demand access after cache_access has handled it.
+// Prefetches are triggered by demand misses and by the first demand hit on a block a
+// prefetch brought in (so a stream that is being covered keeps going), and the
+// prefetched blocks are filled straight into the cache:
+//
+//   nextline:N          - blocks b+1 .. b+N after the triggering block b
+//   stride:N            - a PC-indexed table learns the address stride of every load/store
+//                         instruction; once a stride is seen twice in a row the next N
+//                         addresses along it are prefetched
+//   stream:S:D          - S stream buffers, each tracking one ascending miss stream and
+//                         staying D blocks ahead of it; a miss outside every stream takes
+//                         over the least recently used buffer
+//
+// Every way remembers whether it holds a prefetched block that no demand access has
+// used yet, and when it was prefetched. From that:
+//   accuracy   - used prefetches / prefetches issued
+//   coverage   - used prefetches / (used prefetches + demand misses left)
+//   timeliness - a used prefetch is late if the demand came less than
+//                PREFETCH_TIMELY_DISTANCE accesses after it was issued
+//   pollution  - demand blocks evicted by prefetch fills; their addresses are kept in a
+//                small direct-mapped filter, and a later demand miss found there counts
+//                as a pollution miss
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "writebuf.h"
+
+#define PREFETCH_TIMELY_DISTANCE 64
+#define PREFETCH_STRIDE_ENTRIES 256
+#define PREFETCH_MAX_STREAMS 64
+#define PREFETCH_FILTER_ENTRIES 4096
+
+enum prefetch_model {
+	PREFETCH_NEXTLINE,
+	PREFETCH_STRIDE,
+	PREFETCH_STREAM
+};
+
+char *prefetch_model_names[] = { "NEXT-LINE", "STRIDE", "STREAM" };
+
+struct prefetch_stride_entry {
+	unsigned int pc;
+	unsigned long last_address;
+	long stride;
+	int confidence;          // 0..3, prefetches are issued from 2 up
+};
+
+struct prefetch_stream {
+	unsigned long start;     // first block of the stream still expected
+	unsigned long next;      // next block to prefetch
+	unsigned long long used; // last time the stream was touched, for replacement
+	int valid;
+};
+
+struct prefetch_t {
+	struct cache_t *cp;
+	struct writebuf_t *writebuf;       // memory traffic of the fills, NULL when not kept
+	enum prefetch_model model;
+	int degree;              // blocks per trigger (nextline, stride)
+	int nstreams;
+	int depth;               // blocks ahead (stream)
+
+	unsigned char *prefetched;         // per way: prefetched and not used yet
+	unsigned long long *issued_at;     // per way: time of the prefetch
+	unsigned long *filter;             // block + 1 of demand blocks evicted by prefetches
+	struct prefetch_stride_entry stride_table[PREFETCH_STRIDE_ENTRIES];
+	struct prefetch_stream streams[PREFETCH_MAX_STREAMS];
+
+	unsigned long long issued;
+	unsigned long long useful;
+	unsigned long long late;
+	unsigned long long demand_misses;
+	unsigned long long evictions;       // demand blocks replaced by prefetches
+	unsigned long long pollution_misses;
+	unsigned long long writebacks;      // dirty blocks replaced by prefetches
+};
+
+// Parses nextline[:N], stride[:N] or stream[:S[:D]] and attaches the prefetcher to cp. Returns NULL on a bad spec.
+struct prefetch_t * prefetch_create(struct cache_t *cp, const char *spec)
+{
+	struct prefetch_t *P = (struct prefetch_t *)calloc(1, sizeof(struct prefetch_t));
+	int a = 0, b = 0, n;
+
+	if (strncmp(spec, "nextline", 8) == 0) {
+		P->model = PREFETCH_NEXTLINE;
+		n = sscanf(spec + 8, ":%d", &a);
+		P->degree = (n == 1) ? a : 1;
+	}
+	else if (strncmp(spec, "stride", 6) == 0) {
+		P->model = PREFETCH_STRIDE;
+		n = sscanf(spec + 6, ":%d", &a);
+		P->degree = (n == 1) ? a : 1;
+	}
+	else if (strncmp(spec, "stream", 6) == 0) {
+		P->model = PREFETCH_STREAM;
+		n = sscanf(spec + 6, ":%d:%d", &a, &b);
+		P->nstreams = (n >= 1) ? a : 4;
+		P->depth = (n == 2) ? b : 4;
+		P->degree = 1;
+	}
+	else {
+		free(P);
+		return NULL;
+	}
+	if (P->degree <= 0 || (P->model == PREFETCH_STREAM && (P->nstreams <= 0 || P->nstreams > PREFETCH_MAX_STREAMS || P->depth <= 0))) {
+		free(P);
+		return NULL;
+	}
+
+	P->cp = cp;
+	P->prefetched = (unsigned char *)calloc((size_t)cp->nsets * cp->assoc, 1);
+	P->issued_at = (unsigned long long *)calloc((size_t)cp->nsets * cp->assoc, sizeof(unsigned long long));
+	P->filter = (unsigned long *)calloc(PREFETCH_FILTER_ENTRIES, sizeof(unsigned long));
+	return P;
+}
+
+static inline unsigned int prefetch_filter_slot(unsigned long block)
+{
+	return (unsigned int)((block * 0x9E3779B97F4A7C15ull) >> 32) & (PREFETCH_FILTER_ENTRIES - 1);
+}
+
+// Brings block into the cache unless it is already there
+void prefetch_block(struct prefetch_t *P, unsigned long block, unsigned long long now)
+{
+	struct cache_t *cp = P->cp;
+	unsigned long long *sample_counts = cp->sample_counts;
+	unsigned long address = block << cp->n_bits_for_block_offset;
+	unsigned long tag, set;
+	size_t index;
+	int way, status;
+
+	cache_decompose(cp, address, &tag, &set);
+	if (cache_find_way(cp, (int)set, tag) >= 0) {
+		return;
+	}
+
+	// prefetch fills are not demand misses, keep them out of the sampled counts
+	cp->sample_counts = NULL;
+	status = cache_access_block(cp, tag, set, ti_LOAD, now);
+	cp->sample_counts = sample_counts;
+	if (status == CACHE_NOT_SAMPLED) {
+		return;
+	}
+	if (P->writebuf) {
+		writebuf_fill(P->writebuf, status);
+	}
+
+	way = cache_find_way(cp, (int)set, tag);
+	index = set * cp->assoc + way;
+	if (cp->evicted && !P->prefetched[index]) {
+		// a demand block made room for the prefetch
+		unsigned long victim = (unsigned long)(cp->evicted_address >> cp->n_bits_for_block_offset);
+		P->evictions++;
+		P->filter[prefetch_filter_slot(victim)] = victim + 1;
+	}
+	if (status == 2) {
+		P->writebacks++;
+	}
+	P->prefetched[index] = 1;
+	P->issued_at[index] = now;
+	P->issued++;
+}
+
+// Trains the stride table on one access. Returns the entry when its stride is confirmed.
+struct prefetch_stride_entry * prefetch_train_stride(struct prefetch_t *P, unsigned int pc, unsigned long address)
+{
+	struct prefetch_stride_entry *e = &P->stride_table[(pc >> 2) & (PREFETCH_STRIDE_ENTRIES - 1)];
+	long stride;
+
+	if (e->pc != pc) {
+		e->pc = pc;
+		e->last_address = address;
+		e->stride = 0;
+		e->confidence = 0;
+		return NULL;
+	}
+
+	stride = (long)address - (long)e->last_address;
+	e->last_address = address;
+	if (stride != 0 && stride == e->stride) {
+		if (e->confidence < 3) e->confidence++;
+	}
+	else {
+		if (e->confidence > 0) e->confidence--;
+		if (e->confidence == 0) e->stride = stride;
+	}
+	return (e->confidence >= 2) ? e : NULL;
+}
+
+// Issues the prefetches for a trigger at block, according to the model
+void prefetch_trigger(struct prefetch_t *P, unsigned long block, struct prefetch_stride_entry *e, unsigned long address, unsigned long long now)
+{
+	struct prefetch_stream *s, *victim = NULL;
+	int i;
+
+	switch (P->model) {
+		case PREFETCH_NEXTLINE:
+			for (i = 1; i <= P->degree; i++) {
+				prefetch_block(P, block + i, now);
+			}
+			break;
+
+		case PREFETCH_STRIDE:
+			if (!e) break;
+			for (i = 1; i <= P->degree; i++) {
+				prefetch_block(P, (unsigned long)((long)address + e->stride * i) >> P->cp->n_bits_for_block_offset, now);
+			}
+			break;
+
+		case PREFETCH_STREAM:
+			for (i = 0; i < P->nstreams; i++) {
+				s = &P->streams[i];
+				if (s->valid && block >= s->start && block < s->next) {
+					break;
+				}
+				if (!victim || !s->valid || (victim->valid && s->used < victim->used)) {
+					victim = s;
+				}
+			}
+			if (i < P->nstreams) {
+				s = &P->streams[i];
+			}
+			else {
+				s = victim;
+				s->valid = 1;
+				s->next = block + 1;
+			}
+			s->start = block + 1;
+			s->used = now;
+			while (s->next < block + 1 + P->depth) {
+				prefetch_block(P, s->next, now);
+				s->next++;
+			}
+			break;
+	}
+}
+
+// Runs the prefetch stage for a demand access; status is what cache_access returned
+void prefetch_access(struct prefetch_t *P, unsigned long address, unsigned int pc, int status, unsigned long long now)
+{
+	struct cache_t *cp = P->cp;
+	struct prefetch_stride_entry *e = NULL;
+	unsigned long tag, set, block = address >> cp->n_bits_for_block_offset;
+	size_t index;
+	int way, trigger = 0;
+
+	if (status == CACHE_NOT_SAMPLED) {
+		return;
+	}
+	if (P->model == PREFETCH_STRIDE) {
+		e = prefetch_train_stride(P, pc, address);
+	}
+
+	// a store miss under no-write-allocate leaves the block out of the cache (way < 0)
+	cache_decompose(cp, address, &tag, &set);
+	way = cache_find_way(cp, (int)set, tag);
+	index = set * cp->assoc + (way >= 0 ? way : 0);
+
+	if (status == 0) {
+		if (P->prefetched[index]) {
+			// first use of a prefetched block
+			P->prefetched[index] = 0;
+			P->useful++;
+			if (now - P->issued_at[index] < PREFETCH_TIMELY_DISTANCE) {
+				P->late++;
+			}
+			trigger = 1;
+		}
+	}
+	else {
+		P->demand_misses++;
+		if (way >= 0) {
+			P->prefetched[index] = 0;
+		}
+		if (P->filter[prefetch_filter_slot(block)] == block + 1) {
+			P->filter[prefetch_filter_slot(block)] = 0;
+			P->pollution_misses++;
+		}
+		trigger = 1;
+	}
+
+	if (trigger) {
+		prefetch_trigger(P, block, e, address, now);
+	}
+}
+
+void prefetch_print_results(struct prefetch_t *P, FILE *file_results)
+{
+	double accuracy = P->issued ? 100.0 * (double)P->useful / (double)P->issued : 0;
+	double coverage = (P->useful + P->demand_misses) ? 100.0 * (double)P->useful / (double)(P->useful + P->demand_misses) : 0;
+
+	printf("\n\nPrefetcher: %s", prefetch_model_names[P->model]);
+	fprintf(file_results, "\n\nPrefetcher: %s", prefetch_model_names[P->model]);
+	if (P->model == PREFETCH_STREAM) {
+		printf(" (%d streams, %d blocks ahead)", P->nstreams, P->depth);
+		fprintf(file_results, " (%d streams, %d blocks ahead)", P->nstreams, P->depth);
+	}
+	else {
+		printf(" (degree %d)", P->degree);
+		fprintf(file_results, " (degree %d)", P->degree);
+	}
+	printf("\nPrefetches Issued: %llu", P->issued);
+	fprintf(file_results, "\nPrefetches Issued: %llu", P->issued);
+	printf("\nPrefetches Used: %llu", P->useful);
+	fprintf(file_results, "\nPrefetches Used: %llu", P->useful);
+	printf("\nPrefetches Used Late: %llu", P->late);
+	fprintf(file_results, "\nPrefetches Used Late: %llu", P->late);
+	printf("\nPrefetch Accuracy: %.2f%%", accuracy);
+	fprintf(file_results, "\nPrefetch Accuracy: %.2f%%", accuracy);
+	printf("\nPrefetch Coverage: %.2f%%", coverage);
+	fprintf(file_results, "\nPrefetch Coverage: %.2f%%", coverage);
+	printf("\nPrefetch Evictions: %llu", P->evictions);
+	fprintf(file_results, "\nPrefetch Evictions: %llu", P->evictions);
+	printf("\nPollution Misses: %llu", P->pollution_misses);
+	fprintf(file_results, "\nPollution Misses: %llu", P->pollution_misses);
+	printf("\nPrefetch Writebacks: %llu", P->writebacks);
+	fprintf(file_results, "\nPrefetch Writebacks: %llu", P->writebacks);
+}
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef __SAMPLING_H__
+#define __SAMPLING_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Set-sampling estimates.
+// With cache_set_sampling only one set in every K is simulated, so the hits, misses
+// and writebacks of the sampled sets have to be scaled up to the whole cache.
+// The scaling uses a ratio estimator: the fraction of sampled references that were
+// hits (misses, writebacks) times the exact number of accesses in the trace, so the
+// three estimates still add up to the access count.
+//
+// The sampled sets are treated as a sample of the cache's sets, and the 95% interval
+// comes from the spread of the per-set residuals c_i - R * a_i (c_i the count in set
+// i, a_i its references, R the estimated ratio), with the finite population
+// correction for sampling n of N sets:
+//
+//     Var(estimate) = N^2 * (1 - n/N) / n * sum((c_i - R * a_i)^2) / (n - 1)
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <math.h>
+#include "skeleton.h"
+
+#define SAMPLING_Z95 1.96
+
+struct sampling_estimate {
+	int sampled_sets;
+	int total_sets;
+	unsigned long long sampled_accesses;  // references that fell in a sampled set
+	double value[3];                      // estimated hits, misses, misses with writeback
+	double ci[3];                         // half-width of the 95% confidence interval
+};
+
+// Scales the sampled counts of cp to a trace with the given number of accesses
+void sampling_estimate(struct cache_t *cp, unsigned long long accesses, struct sampling_estimate *e)
+{
+	unsigned long long sums[3] = { 0, 0, 0 };
+	const unsigned long long *c;
+	double ratio, residual, squares, a;
+	int n = cp->nsets >> cp->sample_shift;
+	int i, k;
+
+	memset(e, 0, sizeof(*e));
+	e->sampled_sets = n;
+	e->total_sets = cp->nsets;
+
+	for (i = 0; i < n; i++) {
+		c = &cp->sample_counts[i * 3];
+		for (k = 0; k < 3; k++) {
+			sums[k] += c[k];
+		}
+	}
+	e->sampled_accesses = sums[0] + sums[1] + sums[2];
+	if (!e->sampled_accesses) {
+		return; //nothing landed in a sampled set, there is no estimate
+	}
+
+	for (k = 0; k < 3; k++) {
+		ratio = (double)sums[k] / (double)e->sampled_accesses;
+		e->value[k] = ratio * (double)accesses;
+
+		if (n < 2 || n == cp->nsets) {
+			continue; //a single set gives no spread, and all of them give an exact count
+		}
+		squares = 0;
+		for (i = 0; i < n; i++) {
+			c = &cp->sample_counts[i * 3];
+			a = (double)(c[0] + c[1] + c[2]);
+			residual = (double)c[k] - ratio * a;
+			squares += residual * residual;
+		}
+		e->ci[k] = SAMPLING_Z95 * (double)cp->nsets
+			* sqrt((1.0 - (double)n / (double)cp->nsets) / (double)n * squares / (double)(n - 1));
+	}
+}
+
+// Prints the scaled hits, misses and writebacks of a sampled run, each with its 95% interval
+void sampling_print_results(struct cache_t *cp, unsigned long long accesses, FILE *file_results)
+{
+	struct sampling_estimate e;
+
+	sampling_estimate(cp, accesses, &e);
+
+	printf("\nSampled Sets: %d of %d (%llu accesses simulated)", e.sampled_sets, e.total_sets, e.sampled_accesses);
+	fprintf(file_results, "\nSampled Sets: %d of %d (%llu accesses simulated)", e.sampled_sets, e.total_sets, e.sampled_accesses);
+	printf("\nCache Hits: %.0f +/- %.0f (95%% CI)", e.value[0], e.ci[0]);
+	fprintf(file_results, "\nCache Hits: %.0f +/- %.0f (95%% CI)", e.value[0], e.ci[0]);
+	printf("\nCache Misses: %.0f +/- %.0f (95%% CI)", e.value[1], e.ci[1]);
+	fprintf(file_results, "\nCache Misses: %.0f +/- %.0f (95%% CI)", e.value[1], e.ci[1]);
+	printf("\nCache Writebacks: %.0f +/- %.0f (95%% CI)", e.value[2], e.ci[2]);
+	fprintf(file_results, "\nCache Writebacks: %.0f +/- %.0f (95%% CI)", e.value[2], e.ci[2]);
+}
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef __SIM_CONTEXT_H__
+#define __SIM_CONTEXT_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// State of one simulation: its trace reader, how far into the trace it is, the
+// region being simulated and the access counters. Nothing here is shared, so any
+// number of simulations can run side by side in one process, each on its own
+// context (see batch.h).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "trace_reader.h"
+
+struct sim_context {
+	struct trace_reader_t *trace_reader;
+	unsigned long long trace_records;     // records read so far
+	unsigned long long record_limit;      // the trace ends after this many records, 0 for the whole trace
+	unsigned long long progress_interval; // records between progress lines, 0 for none
+	double progress_start;
+
+	// to keep statistics
+	unsigned long long accesses;
+	unsigned long long read_accesses;
+	unsigned long long write_accesses;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long misses_with_writeback;
+};
+
+double progress_seconds()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+}
+
+// Opens the trace of ctx and clears everything else. Returns 0 if the trace cannot be read.
+int sim_open(struct sim_context *ctx, char *trace_file_name, enum trace_reader_mode mode)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->trace_reader = trace_reader_open(trace_file_name, mode);
+	ctx->progress_start = progress_seconds();
+	return ctx->trace_reader != NULL;
+}
+
+void sim_close(struct sim_context *ctx)
+{
+	trace_reader_close(ctx->trace_reader);
+	ctx->trace_reader = NULL;
+}
+
+// Reports how far into the trace the run is, on stderr so the results stay clean
+void progress_print(struct sim_context *ctx)
+{
+	double elapsed = progress_seconds() - ctx->progress_start;
+
+	fprintf(stderr, "Progress: %lluM records, %.1f s, %.2fM records/s\n", ctx->trace_records / 1000000, elapsed,
+		elapsed > 0 ? (double)ctx->trace_records / elapsed / 1e6 : 0.0);
+}
+
+int sim_next(struct sim_context *ctx, const struct trace_item **item)
+{
+	int size;
+
+	if (ctx->record_limit && ctx->trace_records >= ctx->record_limit) {
+		return 0; //end of the region being simulated
+	}
+	size = trace_reader_next(ctx->trace_reader, item);
+	if (size) {
+		ctx->trace_records++;
+		if (ctx->progress_interval && ctx->trace_records % ctx->progress_interval == 0) {
+			progress_print(ctx);
+		}
+	}
+	return size;
+}
+
+// Reads past the next n records without simulating them. Returns the number skipped.
+unsigned long long sim_skip(struct sim_context *ctx, unsigned long long n)
+{
+	const struct trace_item *item;
+	unsigned long long skipped = 0;
+
+	while (skipped < n && sim_next(ctx, &item)) {
+		skipped++;
+	}
+	return skipped;
+}
+
+#endif
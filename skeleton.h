@@ -11,10 +11,15 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <sys/time.h> //only for linux
 #include "trace_item.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #define CHECK_BIT(var,pos) ((var) & (1<<(pos))) //macro for checking if bit at position pos is 1
 
 /////////////////////////////////////////////////////////////////////
@@ -49,18 +54,28 @@ int gettimeofday(struct timeval * tp, struct timezone * tzp) {
 //FOR WINDOWS ONLY
 /////////////////////////////////////////////////////////////////////
 
-struct cache_blk_t {
-    unsigned long tag;
-    char valid;
-    char dirty;
-    unsigned long long timestamp;
-};
-
 enum cache_policy {
     LRU,
-    FIFO
+    FIFO,
+    PLRU_TREE,   // tree pseudo-LRU, assoc - 1 bits per set
+    PLRU_BIT,    // bit pseudo-LRU (MRU bits), assoc bits per set
+    SRRIP,       // static re-reference interval prediction, 2-bit RRPV
+    BRRIP,       // bimodal RRIP: most blocks are inserted at distant re-reference
+    RANDOM,
+    OPT          // Belady's optimal replacement: evicts the block referenced furthest in the future (see opt.h)
 };
 
+#define CACHE_NPOLICIES 8
+#define CACHE_NPOLICIES_ONLINE 7 // the policies that do not need to see the future (all but OPT)
+#define CACHE_RRPV_MAX 3         // 2-bit re-reference prediction values
+#define CACHE_BRRIP_LONG_ONE_IN 32  // BRRIP inserts at RRPV_MAX - 1 once every this many fills
+
+char *cache_policy_names[CACHE_NPOLICIES] = { "LRU", "FIFO", "PLRU-TREE", "PLRU-BIT", "SRRIP", "BRRIP", "RANDOM", "OPT" };
+
+// The blocks are stored as a structure of arrays so that a lookup only touches the
+// tags of one set: tags and timestamps of a set are contiguous, and the valid and
+// dirty bits of a set are packed into bitmasks (bit i = way i).
+// Timestamps come from a logical clock (one tick per access) supplied by the caller.
 struct cache_t {
     int nsets;        // # sets
     int bsize;        // block size
@@ -68,22 +83,77 @@ struct cache_t {
     
     enum cache_policy policy;       // cache replacement policy
     
-    // ** Is a pointer to a pointer, we want to make a linked list of cache_blk_t
-    struct cache_blk_t **blocks;    // cache blocks in the cache
+    // address decomposition, computed once in cache_create
+    int n_bits_for_block_offset;
+    int n_bits_for_set_number;
+    int tag_shift;                  // n_bits_for_block_offset + n_bits_for_set_number
+    unsigned long set_mask;         // nsets - 1
+    
+    int mask_words;                 // 64-bit words per set in the valid/dirty bitmasks
+    unsigned long long *tags;       // nsets * assoc tags, set by set
+    unsigned long long *timestamps; // nsets * assoc replacement timestamps, set by set
+    unsigned long long *valid;      // nsets * mask_words valid bits
+    unsigned long long *dirty;      // nsets * mask_words dirty bits
+    
+    // bit state of the pseudo-LRU and RRIP policies:
+    //   PLRU_TREE - node i of the set's tree at bit i (nodes 1..assoc-1)
+    //   PLRU_BIT  - MRU bit of each way
+    //   SRRIP/BRRIP - one way mask per RRPV value 0..CACHE_RRPV_MAX
+    int repl_words;                 // 64-bit words per set in repl_bits
+    unsigned long long *repl_bits;
+    unsigned long long rng;         // xorshift state for RANDOM and BRRIP
+    
+    // the block replaced by the last cache_access: 0 none (hit or empty way), 1 clean, 2 dirty
+    int evicted;
+    unsigned long long evicted_address;
+    
+    // write policy (cache_set_write_policy), write-back with write-allocate by default
+    int write_through;              // stores update memory right away and never leave blocks dirty
+    int no_write_allocate;          // store misses go to memory without bringing the block in
+    
+    // set sampling (cache_set_sampling): only the sets with (set & sample_mask) == 0 are simulated
+    unsigned long sample_mask;
+    int sample_shift;               // log2 of the sampling ratio
+    unsigned long long *sample_counts; // hits, misses and misses with writeback of each sampled set
+    
+    // cache_access_block specialized for this associativity and policy (see cache_select_engine),
+    // NULL when the geometry has no specialized engine and the generic code runs
+    int (*engine)(struct cache_t *cp, unsigned long tag, unsigned long set, char access_type, unsigned long long now);
+    
+    // OPT (opt_create): for the access at logical time t, next_use[t - 1] is the distance to the next
+    // access to the same block (0 for none); timestamps then hold the time each block is next used
+    const unsigned int *next_use;
+    unsigned long long next_use_count;
 };
 
+#define CACHE_NOT_SAMPLED 3 // cache_access status of a reference to a set that is not simulated
+
+#define CACHE_WAY_BIT(way) (1ULL << ((way) & 63))
+#define CACHE_WAY_WORD(cp, set, way) ((size_t)(set) * (cp)->mask_words + ((way) >> 6))
+
+void cache_select_engine(struct cache_t *cp);
+
+// Zeroed allocation aligned for vector loads of whole sets
+void * cache_alloc_array(size_t count, size_t size)
+{
+    void *p = NULL;
+    
+    if (posix_memalign(&p, 64, (count * size) > 0 ? count * size : 64)) {
+        fprintf(stdout, "** cache arrays not allocated\n");
+        exit(-1);
+    }
+    memset(p, 0, count * size);
+    return p;
+}
+
 struct cache_t * cache_create(int size, int blocksize, int assoc, enum cache_policy policy)
 {
-    // The cache is represented by a 2-D array of blocks.
-    // The first dimension of the 2D array is "nsets" which is the number of sets (entries)
-    // The second dimension is "assoc", which is the number of blocks in each set.
+    // The cache is represented by flat arrays indexed by set * assoc + way.
+    // "nsets" is the number of sets (entries) and "assoc" is the number of blocks in each set.
     
-    int i;
-    int nblocks = 1; // number of blocks in the cache
     int nsets = 1;   // number of sets (entries) in the cache
     
-	//calculate number of blocks and sets in cache
-	nblocks = (size * 1024) / blocksize;
+	//calculate number of sets in cache
 	nsets = (size * 1024) / (blocksize * assoc);
     
     struct cache_t * C = (struct cache_t *)calloc(1, sizeof(struct cache_t));
@@ -93,29 +163,150 @@ struct cache_t * cache_create(int size, int blocksize, int assoc, enum cache_pol
     C->assoc = assoc;
     C->policy = policy;
     
-    C->blocks= (struct cache_blk_t **)calloc(nsets, sizeof(struct cache_blk_t));
+    // block size and number of sets are powers of 2
+    C->n_bits_for_block_offset = __builtin_ctz(blocksize);
+    C->n_bits_for_set_number = nsets > 0 ? __builtin_ctz(nsets) : 0;
+    C->tag_shift = C->n_bits_for_block_offset + C->n_bits_for_set_number;
+    C->set_mask = (unsigned long)nsets - 1;
     
-    for(i = 0; i < nsets; i++) {
-        C->blocks[i] = (struct cache_blk_t *)calloc(assoc, sizeof(struct cache_blk_t));
+    C->mask_words = (assoc + 63) / 64;
+    C->tags = (unsigned long long *)cache_alloc_array((size_t)nsets * assoc, sizeof(unsigned long long));
+    C->timestamps = (unsigned long long *)cache_alloc_array((size_t)nsets * assoc, sizeof(unsigned long long));
+    C->valid = (unsigned long long *)cache_alloc_array((size_t)nsets * C->mask_words, sizeof(unsigned long long));
+    C->dirty = (unsigned long long *)cache_alloc_array((size_t)nsets * C->mask_words, sizeof(unsigned long long));
+    
+    if (policy == SRRIP || policy == BRRIP) {
+        C->repl_words = (CACHE_RRPV_MAX + 1) * C->mask_words;
+    }
+    else if (policy == PLRU_TREE || policy == PLRU_BIT) {
+        C->repl_words = C->mask_words;
     }
+    C->repl_bits = (unsigned long long *)cache_alloc_array((size_t)nsets * C->repl_words, sizeof(unsigned long long));
+    C->rng = 0x9E3779B97F4A7C15ULL; // fixed seed so runs are repeatable
+    cache_select_engine(C);
 
     return C;
 }
 
-// Constructs a new block to be put in the set
-void constructNewBlock(struct cache_blk_t *newBlock, unsigned long tag, unsigned long long now){
-	newBlock->valid = 1;
-	newBlock->tag = tag;
-	newBlock->dirty = 0;
-	newBlock->timestamp = now;
+// Releases cp and every array cache_create (or cache_set_sampling) allocated for it
+void cache_free(struct cache_t *cp)
+{
+    free(cp->tags);
+    free(cp->timestamps);
+    free(cp->valid);
+    free(cp->dirty);
+    free(cp->repl_bits);
+    free(cp->sample_counts);
+    free(cp);
+}
+
+// Selects write-through or write-back, and write-allocate or no-write-allocate.
+// Under write-through no block is ever dirty, so cache_access never returns 2; under
+// no-write-allocate a store miss returns 1 and leaves the cache untouched.
+void cache_set_write_policy(struct cache_t *cp, int write_through, int no_write_allocate)
+{
+    cp->write_through = write_through;
+    cp->no_write_allocate = no_write_allocate;
+}
+
+// Simulates only one set in every one_in (a power of 2), evenly spread over the cache.
+// References to the other sets return CACHE_NOT_SAMPLED without touching any block.
+void cache_set_sampling(struct cache_t *cp, int one_in)
+{
+    int shift = 0;
+    
+    while ((1 << shift) < one_in && (1 << shift) < cp->nsets) {
+        shift++;
+    }
+    cp->sample_shift = shift;
+    cp->sample_mask = (1UL << shift) - 1;
+    free(cp->sample_counts);
+    cp->sample_counts = (unsigned long long *)calloc((size_t)(cp->nsets >> shift) * 3, sizeof(unsigned long long));
+}
+
+// Splits address into the tag and the set it maps to in cp
+static inline void cache_decompose(struct cache_t *cp, unsigned long address, unsigned long *tag, unsigned long *set)
+{
+	*tag = address >> cp->tag_shift;
+	*set = (address >> cp->n_bits_for_block_offset) & cp->set_mask;
+}
+
+// Rebuilds the address of the first byte of a block from its tag and set (the inverse of cache_decompose)
+unsigned long long cache_block_address(struct cache_t *cp, unsigned long long tag, int set)
+{
+	return (tag << cp->tag_shift) | ((unsigned long long)set << cp->n_bits_for_block_offset);
+}
+
+/*
+	Returns the way of set holding tag, or -1 if it is not in the set.
+	All ways of the set are compared at once with AVX2 (4 tags per compare) or SSE2 (2 tags per compare),
+	and the match bits are masked with the valid bits of the same ways. Sets smaller than one vector,
+	and builds without either instruction set, fall back to the scalar loop.
+*/
+int cache_find_way(struct cache_t *cp, int set, unsigned long long tag)
+{
+	const unsigned long long *set_tags = cp->tags + (size_t)set * cp->assoc;
+	const unsigned long long *set_valid = cp->valid + (size_t)set * cp->mask_words;
+	int way = 0;
+
+#if defined(__AVX2__)
+	__m256i key = _mm256_set1_epi64x((long long)tag);
+	for (; way + 4 <= cp->assoc; way += 4) {
+		__m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)(set_tags + way)), key);
+		unsigned int match = (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(eq));
+		match &= (unsigned int)(set_valid[way >> 6] >> (way & 63)) & 0xf;
+		if (match) {
+			return way + __builtin_ctz(match);
+		}
+	}
+#elif defined(__SSE2__)
+	__m128i key = _mm_set1_epi64x((long long)tag);
+	for (; way + 2 <= cp->assoc; way += 2) {
+		// SSE2 has no 64-bit compare: both 32-bit halves have to match
+		__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(set_tags + way)), key);
+		eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+		unsigned int match = (unsigned int)_mm_movemask_pd(_mm_castsi128_pd(eq));
+		match &= (unsigned int)(set_valid[way >> 6] >> (way & 63)) & 0x3;
+		if (match) {
+			return way + __builtin_ctz(match);
+		}
+	}
+#endif
+
+	for (; way < cp->assoc; way++) {
+		if ((set_valid[way >> 6] & CACHE_WAY_BIT(way)) && set_tags[way] == tag) {
+			return way;
+		}
+	}
+	return -1;
+}
+
+// Returns the first way of the set that does not hold a block yet, or -1 if the set is full
+int findEmptyBlock(struct cache_t *cp, int set){
+	const unsigned long long *set_valid = cp->valid + (size_t)set * cp->mask_words;
+	unsigned long long empty;
+	int w;
+
+	for(w = 0; w < cp->mask_words; w++){
+		empty = ~set_valid[w];
+		if(cp->assoc - w * 64 < 64){
+			empty &= (1ULL << (cp->assoc - w * 64)) - 1;
+		}
+		if(empty){
+			return w * 64 + __builtin_ctzll(empty);
+		}
+	}
+
+	return -1;
 }
 
 // Returns the index of the oldest block in the set
 int findOldestBlock(struct cache_t *cp, int set){
-	int index = cp->blocks[set][0].timestamp, i;
+	const unsigned long long *set_timestamps = cp->timestamps + (size_t)set * cp->assoc;
+	int index = 0, i;
 
 	for(i = 1; i < cp->assoc; i++){
-	if(cp->blocks[set][i].timestamp < cp->blocks[set][i-1].timestamp){
+		if(set_timestamps[i] < set_timestamps[index]){
 			index = i;
 		}
 	}
@@ -123,169 +314,492 @@ int findOldestBlock(struct cache_t *cp, int set){
 	return index;
 }
 
+// Puts a new block for tag into way of set. Returns 2 if the block it replaces has to be written back, 1 otherwise.
+int constructNewBlock(struct cache_t *cp, int set, int way, unsigned long long tag, char access_type, unsigned long long now){
+	size_t word = CACHE_WAY_WORD(cp, set, way);
+	unsigned long long bit = CACHE_WAY_BIT(way);
+	int returnValue = 1;
+
+	// Evicting a modified block costs a write back to memory
+	if((cp->valid[word] & bit) && (cp->dirty[word] & bit)){
+		returnValue = 2;
+	}
+	if(cp->valid[word] & bit){
+		cp->evicted = returnValue;
+		cp->evicted_address = cache_block_address(cp, cp->tags[(size_t)set * cp->assoc + way], set);
+	}
+
+	cp->tags[(size_t)set * cp->assoc + way] = tag;
+	cp->timestamps[(size_t)set * cp->assoc + way] = now;
+	cp->valid[word] |= bit;
+	// Write allocate: a store miss brings the block in and modifies it (unless memory is written through)
+	if(access_type == ti_STORE && !cp->write_through){
+		cp->dirty[word] |= bit;
+	}
+	else{
+		cp->dirty[word] &= ~bit;
+	}
+
+	return returnValue;
+}
+
 /*
 	For LRU replacement, we have to find the element in the set of the cache that is the least recently used.
-	That means we need to go through the entire set of the cache and compare timestamps to find the one that is 
-	the furthest in the past.
+	Hits refresh the timestamp of the block (see cache_access), so the block with the oldest timestamp is the
+	one that was used furthest in the past. Empty ways are filled first.
 */
-int LRU_Replacement(struct cache_t *cp, unsigned long address, int set, char access_type, unsigned long long now) {
+int LRU_Replacement(struct cache_t *cp, unsigned long long tag, int set, char access_type, unsigned long long now) {
 	
-	int returnValue = -1, i;
+	int way = findEmptyBlock(cp, set);
+
+	// The set is full, evict the least recently used block
+	if(way < 0){
+		way = findOldestBlock(cp, set);
+	}
 
-	// The addresses are 32 bits long. Use this to find the tag.
-	unsigned long tag = 32 - log2(cp->bsize) - log2(cp->nsets); 
+	return constructNewBlock(cp, set, way, tag, access_type, now);
+}
 
-	// Now let's check to see if the set is full. We can do that by seeing if every member of the struct is 0.
-	for(i = 0; i < cp->assoc; i++){
+/*
+	For FIFO (First In First Out) replacement, we need to find the element that is at the the start of the 
+	list of cache blocks in a set.
+*/ 
 
-		// We encounter tags that are the same, we have to update it in the cache.
-		// If it is a store instruction mark as dirty, loads just read so not necessary
-		// Also, change the valid bit to 1 if it is already not.
-		// Update the time stamp for LRU!
+/**
+	FIFO IS DIFFERENT THAN LRU BECAUSE YOU DON'T UPDATE THE TIME STAMP IF THERE IS A HIT. IF WE UPDATE THE TIMESTAMP
+	EVERYTIME, THEN IT IS LRU.
+*/
+int FIFO_Replacement(struct cache_t *cp, unsigned long long tag, int set, char access_type, unsigned long long now) {
+	
+	int way = findEmptyBlock(cp, set);
 
-		if(cp->blocks[set][i].tag == tag){
-			// If it is a hit, we only have to set the dirty bit on a store. On a read it doesn't matter.
-			if(access_type == ti_STORE){
-				cp->blocks[set][i].dirty = 1;
-			}
-			cp->blocks[set][i].valid = 1;
-			cp->blocks[set][i].timestamp = now; // Updated time stamp for a hit!
-			returnValue = 0;
-			break;
+	// The set is full, evict the block that was brought in first
+	if(way < 0){
+		way = findOldestBlock(cp, set);
+	}
+
+	return constructNewBlock(cp, set, way, tag, access_type, now);
+}
+
+/*
+	Tree pseudo-LRU keeps a binary tree of assoc - 1 bits per set, stored as a heap (node 1 is the root,
+	the children of node n are 2n and 2n + 1, and the leaves below the last level are the ways).
+	Each bit points to the half of its subtree that was used less recently: 0 for left, 1 for right.
+	The victim is found by following the bits from the root, and an access flips the bits on its
+	path to point away from the way, so both take log2(assoc) steps.
+*/
+int findPLRUTreeBlock(struct cache_t *cp, int set){
+	const unsigned long long *bits = cp->repl_bits + (size_t)set * cp->repl_words;
+	int node = 1;
+
+	while(node < cp->assoc){
+		node = 2 * node + (int)((bits[node >> 6] >> (node & 63)) & 1);
+	}
+
+	return node - cp->assoc;
+}
+
+void touchPLRUTree(struct cache_t *cp, int set, int way){
+	unsigned long long *bits = cp->repl_bits + (size_t)set * cp->repl_words;
+	int node = way + cp->assoc, parent;
+
+	while(node > 1){
+		parent = node >> 1;
+		if(node & 1){
+			bits[parent >> 6] &= ~CACHE_WAY_BIT(parent); // came from the right, point left
 		}
+		else{
+			bits[parent >> 6] |= CACHE_WAY_BIT(parent);  // came from the left, point right
+		}
+		node = parent;
+	}
+}
 
-		// We are encountering a block that has not yet been occupied. We can place it here, It is a miss.
-		else if(!cp->blocks[set][i].valid && !cp->blocks[set][i].tag && !cp->blocks[set][i].dirty && !cp->blocks[set][i].timestamp){ 
+/*
+	Bit pseudo-LRU keeps one MRU bit per way. An access sets the bit of its way, and when that would
+	leave every bit set the others are cleared. The victim is the first way whose bit is clear.
+*/
+int findPLRUBitBlock(struct cache_t *cp, int set){
+	const unsigned long long *mru = cp->repl_bits + (size_t)set * cp->repl_words;
+	unsigned long long clear;
+	int w;
+
+	for(w = 0; w < cp->mask_words; w++){
+		clear = ~mru[w];
+		if(cp->assoc - w * 64 < 64){
+			clear &= (1ULL << (cp->assoc - w * 64)) - 1;
+		}
+		if(clear){
+			return w * 64 + __builtin_ctzll(clear);
+		}
+	}
 
-			// Construct a new block
-			struct cache_blk_t *newBlock = (struct cache_blk_t *)calloc(1, sizeof(struct cache_blk_t));
-			constructNewBlock(newBlock, tag, now);
+	return 0;
+}
 
-			// Now we can add this block where there isn't a block yet
-			cp->blocks[set][i] = *newBlock;
+void touchPLRUBit(struct cache_t *cp, int set, int way){
+	unsigned long long *mru = cp->repl_bits + (size_t)set * cp->repl_words;
+	int w;
 
-			// We have to write back to memory if it is a store instruction.
-			if(access_type == ti_STORE){
-				returnValue = 2;
-			}
-			else if(access_type == ti_LOAD){
-				returnValue = 1;
-			}
+	unsigned long long full;
 
-			break; 
+	mru[way >> 6] |= CACHE_WAY_BIT(way);
+	for(w = 0; w < cp->mask_words; w++){
+		full = (cp->assoc - w * 64 < 64) ? (1ULL << (cp->assoc - w * 64)) - 1 : ~0ULL;
+		if((mru[w] & full) != full){
+			return;
 		}
+	}
 
-		// We have reached the end of the set and we have to evict the oldest
-		// NOTE: Maybe this can be refactored to be outside of for loop?
-		else if(i == (cp->assoc - 1)){
-			// First let's construct a new block
-			struct cache_blk_t *newBlock = (struct cache_blk_t *)calloc(1, sizeof(struct cache_blk_t));
-			constructNewBlock(newBlock, tag, now);
-
-			// Find the oldest block
-			int indexOfOldestBlock = findOldestBlock(cp, set);
-
-			// Now that we have the index of the oldest block, let's overwrite what is there 
-			cp->blocks[set][indexOfOldestBlock] = *newBlock;
-			
-			// We have to write back to memory if it is a store instruction
-			if(access_type == ti_STORE){
-				returnValue = 2;
+	// every way is marked, start a new epoch with only this one
+	for(w = 0; w < cp->mask_words; w++){
+		mru[w] = 0;
+	}
+	mru[way >> 6] = CACHE_WAY_BIT(way);
+}
+
+/*
+	RRIP keeps a 2-bit re-reference prediction value (RRPV) per way, stored as one way mask per value.
+	Hits predict a near re-reference (RRPV 0). The victim is a way predicted for the distant future
+	(RRPV_MAX); if there is none, every way is aged by the same amount in one step by shifting the masks
+	up so that the highest occupied value becomes RRPV_MAX.
+*/
+void setRRPV(struct cache_t *cp, int set, int way, int rrpv){
+	unsigned long long *levels = cp->repl_bits + (size_t)set * cp->repl_words;
+	int r;
+
+	for(r = 0; r <= CACHE_RRPV_MAX; r++){
+		levels[r * cp->mask_words + (way >> 6)] &= ~CACHE_WAY_BIT(way);
+	}
+	levels[rrpv * cp->mask_words + (way >> 6)] |= CACHE_WAY_BIT(way);
+}
+
+int findRRIPBlock(struct cache_t *cp, int set){
+	unsigned long long *levels = cp->repl_bits + (size_t)set * cp->repl_words;
+	int r, w, top = -1, age;
+
+	for(r = CACHE_RRPV_MAX; r >= 0 && top < 0; r--){
+		for(w = 0; w < cp->mask_words; w++){
+			if(levels[r * cp->mask_words + w]){
+				top = r;
+				break;
 			}
-			else if(access_type == ti_LOAD){
-				returnValue = 1;
+		}
+	}
+	if(top < 0){
+		return 0;
+	}
+
+	age = CACHE_RRPV_MAX - top;
+	if(age > 0){
+		for(r = CACHE_RRPV_MAX; r >= 0; r--){
+			for(w = 0; w < cp->mask_words; w++){
+				levels[r * cp->mask_words + w] = (r - age >= 0) ? levels[(r - age) * cp->mask_words + w] : 0;
 			}
+		}
+	}
 
-			break;
+	for(w = 0; w < cp->mask_words; w++){
+		if(levels[CACHE_RRPV_MAX * cp->mask_words + w]){
+			return w * 64 + __builtin_ctzll(levels[CACHE_RRPV_MAX * cp->mask_words + w]);
 		}
+	}
+	return 0;
+}
+
+// xorshift64, so RANDOM and BRRIP do not depend on the C library generator
+unsigned long long cache_random(struct cache_t *cp){
+	cp->rng ^= cp->rng << 13;
+	cp->rng ^= cp->rng >> 7;
+	cp->rng ^= cp->rng << 17;
+	return cp->rng;
+}
+
+int PLRU_Replacement(struct cache_t *cp, unsigned long long tag, int set, char access_type, unsigned long long now) {
+
+	int way = findEmptyBlock(cp, set), returnValue;
+
+	if(way < 0){
+		way = (cp->policy == PLRU_TREE) ? findPLRUTreeBlock(cp, set) : findPLRUBitBlock(cp, set);
+	}
+
+	returnValue = constructNewBlock(cp, set, way, tag, access_type, now);
+	if(cp->policy == PLRU_TREE){
+		touchPLRUTree(cp, set, way);
+	}
+	else{
+		touchPLRUBit(cp, set, way);
+	}
+	return returnValue;
+}
+
+int RRIP_Replacement(struct cache_t *cp, unsigned long long tag, int set, char access_type, unsigned long long now) {
+
+	int way = findEmptyBlock(cp, set), returnValue;
+	int rrpv = CACHE_RRPV_MAX - 1; // SRRIP: long re-reference interval
 
+	if(way < 0){
+		way = findRRIPBlock(cp, set);
 	}
 
+	returnValue = constructNewBlock(cp, set, way, tag, access_type, now);
+	if(cp->policy == BRRIP && (cache_random(cp) % CACHE_BRRIP_LONG_ONE_IN) != 0){
+		rrpv = CACHE_RRPV_MAX; // BRRIP: distant, except once in a while
+	}
+	setRRPV(cp, set, way, rrpv);
 	return returnValue;
 }
 
-/*
-	For FIFO (First In First Out) replacement, we need to find the element that is at the the start of the 
-	list of cache blocks in a set.
-*/ 
+int Random_Replacement(struct cache_t *cp, unsigned long long tag, int set, char access_type, unsigned long long now) {
 
-/**
-	FIFO IS DIFFERENT THAN LRU BECAUSE YOU DON'T UPDATE THE TIME STAMP IF THERE IS A HIT. IF WE UPDATE THE TIMESTAMP
-	EVERYTIME, THEN IT IS LRU.
-*/
-int FIFO_Replacement(struct cache_t *cp, unsigned long address, int set, char access_type, unsigned long long now) {
-	
-	int returnValue = -1, i;
+	int way = findEmptyBlock(cp, set);
 
-	// The addresses are 32 bits long. Use this to find the tag.
-	unsigned long tag = 32 - log2(cp->bsize) - log2(cp->nsets); 
+	if(way < 0){
+		way = (int)(cache_random(cp) % (unsigned long long)cp->assoc);
+	}
 
-	// Loop through the set
-	for(i = 0; i < cp->assoc; i++){
+	return constructNewBlock(cp, set, way, tag, access_type, now);
+}
 
-		// We encounter tags that are the same, we have to update it in the cache.
-		// If it is a store instruction mark as dirty, loads just read so not necessary
-		// Also, change the valid bit to 1 if it is already not.
-		// DO NOT update the time stamp for FIFO!
+/*
+	OPT keeps in each way's timestamp the logical time of the next reference to its block, taken
+	from the next-use array, and evicts the way whose next reference is furthest away. Blocks that
+	are never referenced again count as infinitely far.
+*/
+static inline unsigned long long cache_next_use(struct cache_t *cp, unsigned long long now){
+	unsigned int distance = (now - 1 < cp->next_use_count) ? cp->next_use[now - 1] : 0;
 
-		if(cp->blocks[set][i].tag == tag){
-			// If it is a hit, we only have to set the dirty bit on a store. On a read it doesn't matter.
-			if(access_type == ti_STORE){
-				cp->blocks[set][i].dirty = 1;
-			}
-			cp->blocks[set][i].valid = 1;
-			returnValue = 0;
-			break;
+	return distance ? now + distance : ~0ULL;
+}
+
+int findFurthestBlock(struct cache_t *cp, int set){
+	const unsigned long long *set_timestamps = cp->timestamps + (size_t)set * cp->assoc;
+	int index = 0, i;
+
+	for(i = 1; i < cp->assoc; i++){
+		if(set_timestamps[i] > set_timestamps[index]){
+			index = i;
 		}
+	}
 
-		// If there is a circumstance where the set is not yet full and there is an empty space. This is a miss.
-		// (If everything is 0, that's how we know that nothing is in that space in the set yet)
-		else if(!cp->blocks[set][i].valid && !cp->blocks[set][i].tag && !cp->blocks[set][i].dirty && !cp->blocks[set][i].timestamp){ 
+	return index;
+}
 
-			// Construct a new block
-			struct cache_blk_t *newBlock = (struct cache_blk_t *)calloc(1, sizeof(struct cache_blk_t));
-			constructNewBlock(newBlock, tag, now);
+int OPT_Replacement(struct cache_t *cp, unsigned long long tag, int set, char access_type, unsigned long long now) {
 
-			// Now we can add this block where there isn't a block yet
-			cp->blocks[set][i] = *newBlock;
+	int way = findEmptyBlock(cp, set), returnValue;
 
-			// We have to write back to memory if it is a store instruction.
-			if(access_type == ti_STORE){
-				returnValue = 2;
-			}
-			else if(access_type == ti_LOAD){
-				returnValue = 1;
-			}
+	if(way < 0){
+		way = findFurthestBlock(cp, set);
+	}
 
-			break; 
-		}
+	returnValue = constructNewBlock(cp, set, way, tag, access_type, now);
+	cp->timestamps[(size_t)set * cp->assoc + way] = cache_next_use(cp, now);
+	return returnValue;
+}
+
+/*
+	Specialized engines. cache_engine_body is the whole of cache_access_block for one set of at most
+	64 ways (one valid/dirty word per set) with LRU, FIFO or tree PLRU replacement. It is always inlined
+	and takes the associativity and policy as parameters, so each CACHE_ENGINE(assoc, policy) below
+	compiles into its own function in which they are constants: the tag compare and the oldest-way scan
+	are fully unrolled, the PLRU walks have a fixed depth, the policy branches fold away and the set
+	offsets are constant shifts. cache_create picks the engine for the cache's associativity and
+	policy when one is instantiated; anything else runs the generic code.
+	Results are identical to the generic code, access for access.
+*/
+#define CACHE_ENGINE_INLINE static inline __attribute__((always_inline))
 
-		// We have reached the end of the set and we have to evict the oldest
-		// NOTE: Maybe this can be refactored to be outside of for loop?
-		else if(i == (cp->assoc - 1)){
-			// First let's construct a new block
-			struct cache_blk_t *newBlock = (struct cache_blk_t *)calloc(1, sizeof(struct cache_blk_t));
-			constructNewBlock(newBlock, tag, now);
-
-			// Find the oldest block
-			int indexOfOldestBlock = findOldestBlock(cp, set);
-
-			// Now that we have the index of the oldest block, let's overwrite what is there 
-			cp->blocks[set][indexOfOldestBlock] = *newBlock;
-			
-			// We have to write back to memory if it is a store instruction
-			if(access_type == ti_STORE){
-				returnValue = 2;
+CACHE_ENGINE_INLINE int cache_engine_body(struct cache_t *cp, unsigned long tag, unsigned long set, char access_type,
+	unsigned long long now, const int assoc, const enum cache_policy policy)
+{
+	unsigned long long *set_tags = cp->tags + set * assoc;
+	unsigned long long *set_timestamps = cp->timestamps + set * assoc;
+	unsigned long long *valid = cp->valid + set;
+	unsigned long long *dirty = cp->dirty + set;
+	unsigned long long *tree = cp->repl_bits + set;
+	const unsigned long long all = (assoc == 64) ? ~0ULL : (1ULL << assoc) - 1;
+	unsigned long long oldest, empty, bit;
+	int way, node, i, returnValue;
+
+	cp->evicted = 0;
+
+	if (set & cp->sample_mask) {
+		return CACHE_NOT_SAMPLED;
+	}
+
+	for (way = 0; way < assoc; way++) {
+		if (set_tags[way] == tag && ((*valid >> way) & 1)) break;
+	}
+
+	if (way < assoc) {
+		if (access_type == ti_STORE && !cp->write_through) {
+			*dirty |= 1ULL << way;
+		}
+		if (policy == LRU) {
+			set_timestamps[way] = now;
+		}
+		returnValue = 0;
+	}
+	else if (access_type == ti_STORE && cp->no_write_allocate) {
+		way = -1;
+		returnValue = 1;
+	}
+	else {
+		empty = ~*valid & all;
+		if (empty) {
+			way = __builtin_ctzll(empty);
+		}
+		else if (policy == PLRU_TREE) {
+			for (node = 1; node < assoc; ) {
+				node = 2 * node + (int)((*tree >> node) & 1);
 			}
-			else if(access_type == ti_LOAD){
-				returnValue = 1;
+			way = node - assoc;
+		}
+		else {
+			oldest = set_timestamps[0];
+			way = 0;
+			for (i = 1; i < assoc; i++) {
+				// selects without branching, the compare outcomes are unpredictable
+				way = (set_timestamps[i] < oldest) ? i : way;
+				oldest = (set_timestamps[i] < oldest) ? set_timestamps[i] : oldest;
 			}
+		}
+
+		bit = 1ULL << way;
+		returnValue = 1;
+		if (*valid & bit) {
+			if (*dirty & bit) returnValue = 2;
+			cp->evicted = returnValue;
+			cp->evicted_address = cache_block_address(cp, set_tags[way], (int)set);
+		}
+		set_tags[way] = tag;
+		set_timestamps[way] = now;
+		*valid |= bit;
+		if (access_type == ti_STORE && !cp->write_through) *dirty |= bit;
+		else *dirty &= ~bit;
+	}
 
-			break;
+	if (policy == PLRU_TREE && way >= 0) {
+		for (node = way + assoc; node > 1; node >>= 1) {
+			if (node & 1) *tree &= ~(1ULL << (node >> 1));
+			else *tree |= 1ULL << (node >> 1);
 		}
+	}
+
+	if (cp->sample_counts) {
+		cp->sample_counts[(set >> cp->sample_shift) * 3 + returnValue]++;
+	}
+	return returnValue;
+}
+
+#define CACHE_ENGINE(assoc, policy) \
+	int cache_engine_##policy##_##assoc(struct cache_t *cp, unsigned long tag, unsigned long set, char access_type, unsigned long long now) \
+	{ \
+		return cache_engine_body(cp, tag, set, access_type, now, assoc, policy); \
+	}
 
+CACHE_ENGINE(1, LRU)
+CACHE_ENGINE(2, LRU)
+CACHE_ENGINE(4, LRU)
+CACHE_ENGINE(8, LRU)
+CACHE_ENGINE(16, LRU)
+CACHE_ENGINE(1, FIFO)
+CACHE_ENGINE(2, FIFO)
+CACHE_ENGINE(4, FIFO)
+CACHE_ENGINE(8, FIFO)
+CACHE_ENGINE(16, FIFO)
+CACHE_ENGINE(1, PLRU_TREE)
+CACHE_ENGINE(2, PLRU_TREE)
+CACHE_ENGINE(4, PLRU_TREE)
+CACHE_ENGINE(8, PLRU_TREE)
+CACHE_ENGINE(16, PLRU_TREE)
+
+struct cache_engine_entry {
+	int assoc;
+	enum cache_policy policy;
+	int (*engine)(struct cache_t *cp, unsigned long tag, unsigned long set, char access_type, unsigned long long now);
+};
+
+struct cache_engine_entry cache_engines[] = {
+	{ 1, LRU, cache_engine_LRU_1 }, { 2, LRU, cache_engine_LRU_2 }, { 4, LRU, cache_engine_LRU_4 },
+	{ 8, LRU, cache_engine_LRU_8 }, { 16, LRU, cache_engine_LRU_16 },
+	{ 1, FIFO, cache_engine_FIFO_1 }, { 2, FIFO, cache_engine_FIFO_2 }, { 4, FIFO, cache_engine_FIFO_4 }, { 8, FIFO, cache_engine_FIFO_8 },
+	{ 16, FIFO, cache_engine_FIFO_16 },
+	{ 1, PLRU_TREE, cache_engine_PLRU_TREE_1 }, { 2, PLRU_TREE, cache_engine_PLRU_TREE_2 }, { 4, PLRU_TREE, cache_engine_PLRU_TREE_4 },
+	{ 8, PLRU_TREE, cache_engine_PLRU_TREE_8 }, { 16, PLRU_TREE, cache_engine_PLRU_TREE_16 }
+};
+
+#define CACHE_NENGINES (int)(sizeof(cache_engines) / sizeof(cache_engines[0]))
+
+// Points cp->engine at the specialized engine for its associativity and policy, if there is one
+void cache_select_engine(struct cache_t *cp)
+{
+	int i;
+
+	cp->engine = NULL;
+	for (i = 0; i < CACHE_NENGINES; i++) {
+		if (cache_engines[i].assoc == cp->assoc && cache_engines[i].policy == cp->policy) {
+			cp->engine = cache_engines[i].engine;
+		}
 	}
+}
 
+// cache_access for an address that is already split into tag and set
+int cache_access_block(struct cache_t *cp, unsigned long tag, unsigned long set, char access_type, unsigned long long now)
+{
+	int i, returnValue;
+	
+	if (cp->engine) {
+		return cp->engine(cp, tag, set, access_type, now);
+	}
+	
+	cp->evicted = 0;
+	
+	if (set & cp->sample_mask) {
+		return CACHE_NOT_SAMPLED; //set sampling is on and this set is not simulated
+	}
+	
+	//Check if block contains the right data (check that address is within the range)
+	i = cache_find_way(cp, (int)set, tag);
+	if (i >= 0) { //if yes, return 0
+		// If it is a hit, we only have to set the dirty bit on a store. On a read it doesn't matter.
+		if (access_type == ti_STORE && !cp->write_through) {
+			cp->dirty[CACHE_WAY_WORD(cp, set, i)] |= CACHE_WAY_BIT(i);
+		}
+		// Update the replacement state (FIFO keeps the time the block was brought in)
+		switch (cp->policy) {
+			case LRU: cp->timestamps[set * cp->assoc + i] = now; break;
+			case PLRU_TREE: touchPLRUTree(cp, (int)set, i); break;
+			case PLRU_BIT: touchPLRUBit(cp, (int)set, i); break;
+			case SRRIP:
+			case BRRIP: setRRPV(cp, (int)set, i, 0); break;
+			case OPT: cp->timestamps[set * cp->assoc + i] = cache_next_use(cp, now); break;
+			default: break;
+		}
+		returnValue = 0; //hit
+	}
+	else if (access_type == ti_STORE && cp->no_write_allocate) {
+		returnValue = 1; //the store goes around the cache
+	}
+	else {
+		//if no, run replacement algorithm (which one to kick out)
+		//returns 1 if the victim was clean, 2 if it was dirty and had to be written back
+		switch (cp->policy) {
+			case LRU: returnValue = LRU_Replacement(cp, tag, (int)set, access_type, now); break;
+			case FIFO: returnValue = FIFO_Replacement(cp, tag, (int)set, access_type, now); break;
+			case PLRU_TREE:
+			case PLRU_BIT: returnValue = PLRU_Replacement(cp, tag, (int)set, access_type, now); break;
+			case SRRIP:
+			case BRRIP: returnValue = RRIP_Replacement(cp, tag, (int)set, access_type, now); break;
+			case OPT: returnValue = OPT_Replacement(cp, tag, (int)set, access_type, now); break;
+			default: returnValue = Random_Replacement(cp, tag, (int)set, access_type, now); break;
+		}
+	}
+	
+	if (cp->sample_counts) {
+		cp->sample_counts[(set >> cp->sample_shift) * 3 + returnValue]++;
+	}
 	return returnValue;
 }
 
@@ -296,91 +810,112 @@ int FIFO_Replacement(struct cache_t *cp, unsigned long address, int set, char ac
 // if miss, determine the victim in the set to replace
 // if update the block list based on the replacement policy
 // return 0 if a hit, 1 if a miss or 2 if a miss_with_write_back
+// (CACHE_NOT_SAMPLED if set sampling skipped the reference)
 //
 //////////////////////////////////////////////////////////////////////
 int cache_access(struct cache_t *cp, unsigned long address, char access_type, FILE* file_results, int trace_view_on, unsigned long long now)
 {
-	int block_size; //in bytes
-	int number_of_sets;
-	int n_bits_for_block_offset;
-	int n_bits_for_set_number;
-	int n_bits_for_tag;
 	unsigned long set; //index
 	unsigned long tag;
-	int i; //multipurpose variable
-	
-	//Use address to get set number and tag to access blocks within cashes
-	block_size = cp->bsize;
-	number_of_sets = cp->nsets;
-	
-	n_bits_for_block_offset = -1;
-	for(i = 0; i < (sizeof(block_size)*8); i++) {
-		n_bits_for_block_offset =  n_bits_for_block_offset + 1;
-		if(CHECK_BIT(block_size, i)) {
-			break;
-		}
-	}
 	
-	n_bits_for_set_number = -1;
-	for(i = 0; i < (sizeof(number_of_sets)*8); i++) {
-		n_bits_for_set_number =  n_bits_for_set_number + 1;
-		if(CHECK_BIT(number_of_sets, i)) {
-			break;
-		}
-	}
-	
-	if(cp->assoc == 1) {
-		n_bits_for_tag = sizeof(address)*8 - n_bits_for_set_number;	
-		n_bits_for_tag = sizeof(address)*8 - n_bits_for_set_number - n_bits_for_block_offset;		
-		tag = address >> (n_bits_for_set_number);
-		set = address & (~(tag<<(n_bits_for_set_number)));
-	}
-	else {
-		n_bits_for_tag = sizeof(address)*8 - n_bits_for_set_number - n_bits_for_block_offset;		
-		tag = address >> (n_bits_for_set_number + n_bits_for_block_offset);
-		set = address & (~(tag<<(n_bits_for_set_number + n_bits_for_block_offset)));
-		set = set >> n_bits_for_block_offset;
-	}
+	cache_decompose(cp, address, &tag, &set);
 
 	if (trace_view_on) {
-		//printf("\nNumber of Bits for Block Offset: %d bits", n_bits_for_block_offset);
-		//fprintf(file_results, "\nNumber of Bits for Block Offset: %d bits", n_bits_for_block_offset);
-		//printf("\nNumber of Bits for Set Number: %d bits", n_bits_for_set_number);
-		//fprintf(file_results, "\nNumber of Bits for Set Number: %d bits", n_bits_for_set_number);
-		//printf("\nNumber of Bits for Tag: %d bits", n_bits_for_tag);
-		//fprintf(file_results, "\nNumber of Bits for Tag: %d bits", n_bits_for_tag);
-		printf("\nTag: %d", tag);
-		fprintf(file_results, "\nTag: %x", tag);
-		printf("\nSet: %d", set);
-		fprintf(file_results, "\nSet Number: %d", set);
+		printf("\nTag: %lu", tag);
+		fprintf(file_results, "\nTag: %lx", tag);
+		printf("\nSet: %lu", set);
+		fprintf(file_results, "\nSet Number: %lu", set);
 	}	
 	
-	//Check if block contains the right data (check that address is within the range)
-	for(i = 0; i < cp->assoc; i++){
-		if ((cp->blocks[(int)set][i].valid) && (cp->blocks[(int)set][i].tag == tag)) { //if yes, return 0
-			return 0; //hit
-		} 
-	}
-	//if no, run replacement algorithm (which one to kick out)
-	if(cp->policy == LRU) {
-		if(LRU_Replacement(cp, address, (int)set, access_type, now)== 1){//if not dirty, 
-			return 1; //return 1 and update cache
+	return cache_access_block(cp, tag, set, access_type, now);
+}
+
+struct cache_batch_stats {
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long misses_with_writeback;
+	unsigned long long not_sampled;
+};
+
+#define CACHE_BATCH_SIZE 1024
+
+/*
+	Simulates n accesses in order, the i-th at logical time now + i. The tag/set split of the whole
+	batch is done first in a loop of independent shifts and masks that the compiler can vectorize,
+	then the lookups run back to back. Per-access results go to status (0-3 like cache_access)
+	when it is not NULL, and are added up in stats when it is not NULL.
+*/
+void cache_access_batch(struct cache_t *cp, const unsigned long *addresses, const unsigned char *access_types, int n, unsigned long long now, int *status, struct cache_batch_stats *stats)
+{
+	unsigned long tags[CACHE_BATCH_SIZE];
+	unsigned long sets[CACHE_BATCH_SIZE];
+	unsigned long long counts[4] = { 0, 0, 0, 0 };
+	const int tag_shift = cp->tag_shift, offset_bits = cp->n_bits_for_block_offset;
+	const unsigned long set_mask = cp->set_mask;
+	int base, i, m, r;
+
+	for (base = 0; base < n; base += CACHE_BATCH_SIZE) {
+		m = (n - base < CACHE_BATCH_SIZE) ? n - base : CACHE_BATCH_SIZE;
+
+		for (i = 0; i < m; i++) {
+			tags[i] = addresses[base + i] >> tag_shift;
+			sets[i] = (addresses[base + i] >> offset_bits) & set_mask;
 		}
-		else { //if dirty
-			//write back and update cache
-			return 2;	//return 2
+
+		for (i = 0; i < m; i++) {
+			r = cache_access_block(cp, tags[i], sets[i], access_types[base + i], now + base + i);
+			counts[r]++;
+			if (status) status[base + i] = r;
 		}
 	}
-	else {
-		if(FIFO_Replacement(cp, address, (int)set, access_type, now)== 1){//if not dirty, 
-			return 1; //return 1 and update cache
-		}
-		else { //if dirty
-			//write back and update cache
-			return 2;	//return 2
-		}			
+
+	if (stats) {
+		stats->hits += counts[0];
+		stats->misses += counts[1];
+		stats->misses_with_writeback += counts[2];
+		stats->not_sampled += counts[CACHE_NOT_SAMPLED];
 	}
+}
+
+// Returns 1 if the block holding address is in the cache, without touching any state
+int cache_probe(struct cache_t *cp, unsigned long address)
+{
+	unsigned long set, tag;
+	
+	cache_decompose(cp, address, &tag, &set);
+	return cache_find_way(cp, (int)set, tag) >= 0;
+}
 
+// Removes the block holding address. Returns 0 if it was not cached, 1 if it was clean, 2 if it was dirty.
+int cache_invalidate(struct cache_t *cp, unsigned long address)
+{
+	unsigned long set, tag;
+	size_t word;
+	int way, returnValue;
 	
+	cache_decompose(cp, address, &tag, &set);
+	way = cache_find_way(cp, (int)set, tag);
+	if (way < 0) {
+		return 0;
+	}
+	
+	word = CACHE_WAY_WORD(cp, set, way);
+	returnValue = (cp->dirty[word] & CACHE_WAY_BIT(way)) ? 2 : 1;
+	cp->valid[word] &= ~CACHE_WAY_BIT(way);
+	cp->dirty[word] &= ~CACHE_WAY_BIT(way);
+	return returnValue;
+}
+
+// Marks the block holding address as modified, if it is cached
+void cache_set_dirty(struct cache_t *cp, unsigned long address)
+{
+	unsigned long set, tag;
+	int way;
+	
+	cache_decompose(cp, address, &tag, &set);
+	way = cache_find_way(cp, (int)set, tag);
+	if (way >= 0) {
+		cp->dirty[CACHE_WAY_WORD(cp, set, way)] |= CACHE_WAY_BIT(way);
+	}
 }
 #endif
\ No newline at end of file
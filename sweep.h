@@ -0,0 +1,245 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Sweep mode: simulate many cache configurations in a single pass over the trace.
+// Every decoded trace item is handed to each configuration in turn, so the trace
+// file is read and decoded once no matter how many geometries are being swept.
+//
+// The configuration file has one point per line:
+//     <cache size KB> <block size> <associativity> <replacement policy>
+// Blank lines and lines starting with '#' are ignored.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "sampling.h"
+
+#define SWEEP_LINE_MAX 256
+
+struct sweep_point {
+	int cache_size;         // in kilobytes
+	int block_size;         // in bytes
+	int associativity;
+	int replacement_policy; // enum cache_policy value
+
+	struct cache_t *cp;
+
+	// statistics for this configuration only
+	unsigned long long accesses;
+	unsigned long long read_accesses;
+	unsigned long long write_accesses;
+	unsigned long long hits;
+	unsigned long long misses;
+	unsigned long long misses_with_writeback;
+};
+
+struct sweep_t {
+	unsigned long long clock; // logical time shared by every configuration
+	int npoints;
+	struct sweep_point *points;
+
+	// loads and stores are collected and handed to one configuration at a time,
+	// so each cache's arrays stay hot for a whole batch
+	unsigned long batch_addresses[CACHE_BATCH_SIZE];
+	unsigned char batch_types[CACHE_BATCH_SIZE];
+	int batch_n;
+};
+
+// Reads the configuration file and creates one cache per point. Returns NULL on a bad file.
+struct sweep_t * sweep_create(char *config_file_name)
+{
+	FILE *config_fd;
+	char line[SWEEP_LINE_MAX];
+	int capacity = 16, line_number = 0;
+	struct sweep_point point;
+	struct sweep_t *S;
+
+	config_fd = fopen(config_file_name, "r");
+	if (!config_fd) {
+		fprintf(stdout, "\nsweep file %s not opened.\n", config_file_name);
+		return NULL;
+	}
+
+	S = (struct sweep_t *)calloc(1, sizeof(struct sweep_t));
+	S->points = (struct sweep_point *)calloc(capacity, sizeof(struct sweep_point));
+
+	while (fgets(line, sizeof(line), config_fd)) {
+		char *p = line;
+		line_number++;
+
+		while (*p == ' ' || *p == '\t') p++;
+		if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+		memset(&point, 0, sizeof(point));
+		if (sscanf(p, "%d %d %d %d", &point.cache_size, &point.block_size, &point.associativity, &point.replacement_policy) != 4) {
+			fprintf(stdout, "\n%s:%d: expected <cache size> <block size> <associativity> <replacement policy>\n", config_file_name, line_number);
+			fclose(config_fd);
+			return NULL;
+		}
+
+		//same restrictions as a single run
+		if (point.cache_size <= 0 || point.block_size <= 0 || point.associativity <= 0
+			|| (point.cache_size != (point.cache_size & -point.cache_size))
+			|| (point.block_size != (point.block_size & -point.block_size))
+			|| (point.associativity != (point.associativity & -point.associativity))) {
+			fprintf(stdout, "\n%s:%d: cache size, block size, and block associativity have to be a power of 2.\n", config_file_name, line_number);
+			fclose(config_fd);
+			return NULL;
+		}
+		if (!(point.replacement_policy >= 0 && point.replacement_policy < CACHE_NPOLICIES_ONLINE)) {
+			fprintf(stdout, "\n%s:%d: pick a replacement policy from 0 to %d (OPT only runs as a single cache).\n", config_file_name, line_number, CACHE_NPOLICIES_ONLINE - 1);
+			fclose(config_fd);
+			return NULL;
+		}
+
+		point.cp = cache_create(point.cache_size, point.block_size, point.associativity, (enum cache_policy)point.replacement_policy);
+
+		if (S->npoints == capacity) {
+			capacity = capacity * 2;
+			S->points = (struct sweep_point *)realloc(S->points, capacity * sizeof(struct sweep_point));
+		}
+		S->points[S->npoints] = point;
+		S->npoints++;
+	}
+	fclose(config_fd);
+
+	if (S->npoints == 0) {
+		fprintf(stdout, "\nsweep file %s has no configurations.\n", config_file_name);
+		return NULL;
+	}
+
+	return S;
+}
+
+// Turns on set sampling (one set in one_in) in every configuration
+void sweep_set_sampling(struct sweep_t *S, int one_in)
+{
+	int i;
+
+	for (i = 0; i < S->npoints; i++) {
+		cache_set_sampling(S->points[i].cp, one_in);
+	}
+}
+
+// Simulates the collected loads and stores in every configuration
+void sweep_flush(struct sweep_t *S)
+{
+	int i, j;
+	struct sweep_point *point;
+	struct cache_batch_stats stats;
+
+	if (!S->batch_n) return;
+
+	for (i = 0; i < S->npoints; i++) {
+		point = &S->points[i];
+
+		memset(&stats, 0, sizeof(stats));
+		cache_access_batch(point->cp, S->batch_addresses, S->batch_types, S->batch_n, S->clock + 1, NULL, &stats);
+		point->hits += stats.hits;
+		point->misses += stats.misses;
+		point->misses_with_writeback += stats.misses_with_writeback;
+
+		for (j = 0; j < S->batch_n; j++) {
+			if (S->batch_types[j] == ti_LOAD) {
+				point->read_accesses = point->read_accesses + 1;
+			}
+			else {
+				point->write_accesses = point->write_accesses + 1;
+			}
+		}
+		point->accesses += S->batch_n;
+	}
+
+	S->clock += S->batch_n;
+	S->batch_n = 0;
+}
+
+// Simulates whatever is still collected, then zeroes the statistics of every
+// configuration; the blocks and replacement state stay as they are (end of a warmup)
+void sweep_clear_stats(struct sweep_t *S)
+{
+	struct sweep_point *point;
+	int i;
+
+	sweep_flush(S);
+	for (i = 0; i < S->npoints; i++) {
+		point = &S->points[i];
+		point->accesses = 0;
+		point->read_accesses = 0;
+		point->write_accesses = 0;
+		point->hits = 0;
+		point->misses = 0;
+		point->misses_with_writeback = 0;
+		if (point->cp->sample_counts) {
+			memset(point->cp->sample_counts, 0, (size_t)(point->cp->nsets >> point->cp->sample_shift) * 3 * sizeof(unsigned long long));
+		}
+	}
+}
+
+// Feeds one trace item to every configuration. Statistics are up to date after sweep_flush.
+void sweep_access(struct sweep_t *S, const struct trace_item *tr_entry)
+{
+	if (tr_entry->type != ti_LOAD && tr_entry->type != ti_STORE) {
+		return; //not a load or store
+	}
+
+	S->batch_addresses[S->batch_n] = tr_entry->Addr;
+	S->batch_types[S->batch_n] = tr_entry->type;
+	S->batch_n++;
+	if (S->batch_n == CACHE_BATCH_SIZE) {
+		sweep_flush(S);
+	}
+}
+
+// Prints one parameters/results block per configuration, in the same layout as a single run.
+void sweep_print_results(struct sweep_t *S, char *trace_file_name, FILE *file_results)
+{
+	int i;
+	struct sweep_point *point;
+
+	sweep_flush(S);
+
+	for (i = 0; i < S->npoints; i++) {
+		point = &S->points[i];
+
+		printf("\n\nParameters:");
+		fprintf(file_results, "\n\nParameters:");
+		printf("\nTrace Name: %s", trace_file_name);
+		fprintf(file_results, "\nTrace Name: %s", trace_file_name);
+		printf("\nCache Size: %d KBYTES", point->cache_size);
+		fprintf(file_results, "\nCache Size: %d KBYTES", point->cache_size);
+		printf("\nBlock Size: %d BYTES", point->block_size);
+		fprintf(file_results, "\nBlock Size: %d BYTES", point->block_size);
+		printf("\nAssociativity: %d", point->associativity);
+		fprintf(file_results, "\nAssociativity: %d", point->associativity);
+		printf("\nReplacement Policy: %s", cache_policy_names[point->replacement_policy]);
+		fprintf(file_results, "\nReplacement Policy: %s", cache_policy_names[point->replacement_policy]);
+
+		printf("\n\nResults:");
+		fprintf(file_results, "\n\nResults:");
+		printf("\nCache Accesses: %llu", point->accesses);
+		fprintf(file_results, "\nCache Accesses: %llu", point->accesses);
+		printf("\nCache Read Accesses: %llu", point->read_accesses);
+		fprintf(file_results, "\nCache Read Accesses: %llu", point->read_accesses);
+		printf("\nCache Write Accesses: %llu", point->write_accesses);
+		fprintf(file_results, "\nCache Write Accesses: %llu", point->write_accesses);
+		if (point->cp->sample_counts) {
+			sampling_print_results(point->cp, point->accesses, file_results);
+			continue;
+		}
+		printf("\nCache Hits: %llu", point->hits);
+		fprintf(file_results, "\nCache Hits: %llu", point->hits);
+		printf("\nCache Misses: %llu", point->misses);
+		fprintf(file_results, "\nCache Misses: %llu", point->misses);
+		printf("\nCache Writebacks: %llu", point->misses_with_writeback);
+		fprintf(file_results, "\nCache Writebacks: %llu", point->misses_with_writeback);
+	}
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef __THREEC_H__
+#define __THREEC_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 3C miss classification.
+// Every miss of the simulated cache is put in one class:
+//   compulsory - the block was never referenced before
+//   capacity   - a fully-associative LRU cache with the same number of blocks misses too
+//   conflict   - the fully-associative cache hits, so only the set mapping caused it
+//
+// The fully-associative shadow cache is a hash table of blocks chained into an LRU
+// list (most recent at the head), so a lookup, a move to the front and an eviction
+// are all constant time whatever the capacity. Blocks ever referenced are kept in a
+// separate open-addressing set. Misses of each class are also counted per set.
+//
+// With set sampling only the sampled sets reach the classifier, so the shadow cache
+// holds as many blocks as those sets do, and the class totals are scaled like the
+// hit and miss estimates of sampling.h: by all accesses over the sampled ones.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+
+#define THREEC_NONE -1
+#define THREEC_HIST_BUCKETS 24   // sets with 0, 1, 2-3, 4-7, ... misses
+
+enum threec_class {
+	THREEC_COMPULSORY,
+	THREEC_CAPACITY,
+	THREEC_CONFLICT
+};
+
+char *threec_class_names[] = { "Compulsory", "Capacity", "Conflict" };
+
+struct threec_node {
+	unsigned long block;
+	int prev;      // towards the most recently used block
+	int next;      // towards the least recently used block
+	int chain;     // next node in the same hash bucket
+};
+
+struct threec_t {
+	struct cache_t *cp;          // the simulated cache, for its geometry
+
+	// fully-associative LRU shadow cache
+	int capacity;                // nsets * assoc blocks, of the sampled sets only with sampling
+	int used;
+	struct threec_node *nodes;
+	int *buckets;                // first node of every hash bucket
+	unsigned int bucket_mask;
+	int head;                    // most recently used
+	int tail;                    // least recently used
+
+	// blocks ever referenced, open addressing
+	unsigned long *seen_keys;    // block address + 1, 0 marks an empty slot
+	unsigned int seen_cap;
+	unsigned int seen_count;
+
+	unsigned long long accesses;      // references classified (in a sampled set)
+	unsigned long long misses[3];
+	unsigned long long *set_misses;   // nsets * 3, by set then class
+};
+
+struct threec_t * threec_create(struct cache_t *cp)
+{
+	struct threec_t *T = (struct threec_t *)calloc(1, sizeof(struct threec_t));
+	unsigned int nbuckets = 1;
+	int i;
+
+	T->cp = cp;
+	T->capacity = (cp->sample_counts ? cp->nsets >> cp->sample_shift : cp->nsets) * cp->assoc;
+	T->nodes = (struct threec_node *)malloc(T->capacity * sizeof(struct threec_node));
+	while (nbuckets < 2 * (unsigned int)T->capacity) {
+		nbuckets = nbuckets * 2;
+	}
+	T->buckets = (int *)malloc(nbuckets * sizeof(int));
+	for (i = 0; i < (int)nbuckets; i++) {
+		T->buckets[i] = THREEC_NONE;
+	}
+	T->bucket_mask = nbuckets - 1;
+	T->head = THREEC_NONE;
+	T->tail = THREEC_NONE;
+
+	T->seen_cap = 1024;
+	T->seen_keys = (unsigned long *)calloc(T->seen_cap, sizeof(unsigned long));
+	T->set_misses = (unsigned long long *)calloc((size_t)cp->nsets * 3, sizeof(unsigned long long));
+
+	return T;
+}
+
+static inline unsigned int threec_hash(unsigned long block)
+{
+	return (unsigned int)((block * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// Records block as referenced. Returns 1 if this is its first reference.
+int threec_first_touch(struct threec_t *T, unsigned long block)
+{
+	unsigned int h, i;
+
+	h = threec_hash(block) & (T->seen_cap - 1);
+	while (T->seen_keys[h]) {
+		if (T->seen_keys[h] == block + 1) {
+			return 0;
+		}
+		h = (h + 1) & (T->seen_cap - 1);
+	}
+	T->seen_keys[h] = block + 1;
+	T->seen_count++;
+
+	// keep the table at most half full
+	if (T->seen_count * 2 > T->seen_cap) {
+		unsigned int old_cap = T->seen_cap;
+		unsigned long *old_keys = T->seen_keys;
+
+		T->seen_cap = T->seen_cap * 2;
+		T->seen_keys = (unsigned long *)calloc(T->seen_cap, sizeof(unsigned long));
+		for (i = 0; i < old_cap; i++) {
+			if (old_keys[i]) {
+				h = threec_hash(old_keys[i] - 1) & (T->seen_cap - 1);
+				while (T->seen_keys[h]) {
+					h = (h + 1) & (T->seen_cap - 1);
+				}
+				T->seen_keys[h] = old_keys[i];
+			}
+		}
+		free(old_keys);
+	}
+	return 1;
+}
+
+void threec_unlink(struct threec_t *T, int n)
+{
+	struct threec_node *node = &T->nodes[n];
+
+	if (node->prev != THREEC_NONE) T->nodes[node->prev].next = node->next;
+	else T->head = node->next;
+	if (node->next != THREEC_NONE) T->nodes[node->next].prev = node->prev;
+	else T->tail = node->prev;
+}
+
+void threec_push_front(struct threec_t *T, int n)
+{
+	T->nodes[n].prev = THREEC_NONE;
+	T->nodes[n].next = T->head;
+	if (T->head != THREEC_NONE) T->nodes[T->head].prev = n;
+	else T->tail = n;
+	T->head = n;
+}
+
+// References block in the shadow cache. Returns 1 on a hit; on a miss the LRU block makes room.
+int threec_shadow_access(struct threec_t *T, unsigned long block)
+{
+	unsigned int h = threec_hash(block) & T->bucket_mask;
+	int n, *link;
+
+	for (n = T->buckets[h]; n != THREEC_NONE; n = T->nodes[n].chain) {
+		if (T->nodes[n].block == block) {
+			if (T->head != n) {
+				threec_unlink(T, n);
+				threec_push_front(T, n);
+			}
+			return 1;
+		}
+	}
+
+	if (T->used < T->capacity) {
+		n = T->used;
+		T->used++;
+	}
+	else {
+		// reuse the least recently used node, taking it out of its bucket first
+		n = T->tail;
+		threec_unlink(T, n);
+		link = &T->buckets[threec_hash(T->nodes[n].block) & T->bucket_mask];
+		while (*link != n) {
+			link = &T->nodes[*link].chain;
+		}
+		*link = T->nodes[n].chain;
+	}
+
+	T->nodes[n].block = block;
+	T->nodes[n].chain = T->buckets[h];
+	T->buckets[h] = n;
+	threec_push_front(T, n);
+	return 0;
+}
+
+// Classifies the access cache_access just performed; status is what it returned.
+// Returns the class of a miss, or -1 for a hit (or a reference set sampling skipped).
+int threec_access(struct threec_t *T, unsigned long address, int status)
+{
+	unsigned long block, tag, set;
+	int first, shadow_hit, c;
+
+	if (status == CACHE_NOT_SAMPLED) {
+		return -1;
+	}
+
+	T->accesses++;
+	block = address >> T->cp->n_bits_for_block_offset;
+	first = threec_first_touch(T, block);
+	shadow_hit = threec_shadow_access(T, block);
+	if (status == 0) {
+		return -1;
+	}
+
+	if (first) c = THREEC_COMPULSORY;
+	else if (shadow_hit) c = THREEC_CONFLICT;
+	else c = THREEC_CAPACITY;
+
+	cache_decompose(T->cp, address, &tag, &set);
+	T->misses[c]++;
+	T->set_misses[set * 3 + c]++;
+	return c;
+}
+
+// Zeroes the miss counts, keeping the shadow cache and the blocks seen (end of a warmup)
+void threec_clear_stats(struct threec_t *T)
+{
+	T->accesses = 0;
+	memset(T->misses, 0, sizeof(T->misses));
+	memset(T->set_misses, 0, (size_t)T->cp->nsets * 3 * sizeof(unsigned long long));
+}
+
+// Bucket of a per-set miss count: 0, 1, 2-3, 4-7, ...
+int threec_bucket(unsigned long long count)
+{
+	int b = 0;
+
+	while (count && b < THREEC_HIST_BUCKETS - 1) {
+		count >>= 1;
+		b++;
+	}
+	return b;
+}
+
+// Prints the miss classes, then how many sets fall in each range of misses of each class.
+// accesses is every load and store of the run, to scale sampled counts with.
+void threec_print_results(struct threec_t *T, unsigned long long accesses, FILE *file_results)
+{
+	unsigned long long hist[3][THREEC_HIST_BUCKETS];
+	double scale = 1.0;
+	int c, b, set, last = 0;
+
+	memset(hist, 0, sizeof(hist));
+	for (set = 0; set < T->cp->nsets; set++) {
+		if (T->cp->sample_counts && (set & T->cp->sample_mask)) {
+			continue; //not simulated
+		}
+		for (c = 0; c < 3; c++) {
+			b = threec_bucket(T->set_misses[set * 3 + c]);
+			hist[c][b]++;
+			if (b > last) last = b;
+		}
+	}
+
+	if (T->cp->sample_counts) {
+		if (T->accesses) {
+			scale = (double)accesses / (double)T->accesses;
+		}
+		for (c = 0; c < 3; c++) {
+			printf("\n%s Misses: %.0f (estimated)", threec_class_names[c], (double)T->misses[c] * scale);
+			fprintf(file_results, "\n%s Misses: %.0f (estimated)", threec_class_names[c], (double)T->misses[c] * scale);
+		}
+	}
+	else {
+		for (c = 0; c < 3; c++) {
+			printf("\n%s Misses: %llu", threec_class_names[c], T->misses[c]);
+			fprintf(file_results, "\n%s Misses: %llu", threec_class_names[c], T->misses[c]);
+		}
+	}
+
+	printf("\n\nSets by Misses per Set: compulsory capacity conflict");
+	fprintf(file_results, "\n\nSets by Misses per Set: compulsory capacity conflict");
+	for (b = 0; b <= last; b++) {
+		unsigned long long low = b ? 1ULL << (b - 1) : 0;
+		unsigned long long high = b ? (1ULL << b) - 1 : 0;
+
+		printf("\n%llu-%llu: %llu %llu %llu", low, high, hist[0][b], hist[1][b], hist[2][b]);
+		fprintf(file_results, "\n%llu-%llu: %llu %llu %llu", low, high, hist[0][b], hist[1][b], hist[2][b]);
+	}
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Cycle-approximate timing around the functional cache model.
+// Trace records issue in order, one per cycle. Every load/store is given the latency
+// of the path the functional model took for it (the hit latency of each level it
+// looked in, plus the memory latency if it went that far). The first level is
+// non-blocking: a miss holds one of its MSHRs until the block arrives, and
+//   - a later access to a block that is still in flight merges into that MSHR and
+//     waits only for the rest of the fill (a secondary miss), even though the
+//     functional model already counts it as a hit
+//   - a miss that finds every MSHR busy stalls issue until the first one frees up
+//
+// AMAT is the mean latency of the loads and stores; total cycles is the cycle the
+// last fill completes, issue stalls included. Only demand misses take MSHRs, so a
+// timed run cannot have a prefetcher.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct timing_t {
+	int n_bits_for_block_offset;  // of the first level, MSHRs track its blocks
+	int nmshrs;
+	unsigned long *mshr_block;
+	unsigned long long *mshr_done;  // cycle the fill completes, an MSHR is free once it has passed
+
+	unsigned long long cycle;       // issue cycle of the current record
+	unsigned long long last_done;   // latest completion so far
+
+	unsigned long long accesses;
+	unsigned long long total_latency;
+	unsigned long long primary_misses;
+	unsigned long long secondary_misses;
+	unsigned long long stall_cycles;   // issue cycles lost to MSHR exhaustion
+	unsigned long long mshr_full;      // misses that found no free MSHR
+};
+
+struct timing_t * timing_create(int nmshrs, int n_bits_for_block_offset)
+{
+	struct timing_t *T = (struct timing_t *)calloc(1, sizeof(struct timing_t));
+
+	T->nmshrs = nmshrs;
+	T->n_bits_for_block_offset = n_bits_for_block_offset;
+	T->mshr_block = (unsigned long *)calloc(nmshrs, sizeof(unsigned long));
+	T->mshr_done = (unsigned long long *)calloc(nmshrs, sizeof(unsigned long long));
+	return T;
+}
+
+// Advances to the issue cycle of the next trace record
+static inline void timing_tick(struct timing_t *T)
+{
+	T->cycle++;
+}
+
+// Times one load/store; miss says whether it missed the first level, latency is its full path
+void timing_access(struct timing_t *T, unsigned long address, int miss, unsigned int latency)
+{
+	unsigned long block = address >> T->n_bits_for_block_offset;
+	unsigned long long done;
+	int i, free_mshr = -1, earliest = -1;
+
+	T->accesses++;
+
+	for (i = 0; i < T->nmshrs; i++) {
+		if (T->mshr_done[i] > T->cycle) {
+			if (T->mshr_block[i] == block) {
+				// the block is still on its way: wait for the fill already in flight
+				T->secondary_misses++;
+				T->total_latency += T->mshr_done[i] - T->cycle;
+				return;
+			}
+			if (earliest < 0 || T->mshr_done[i] < T->mshr_done[earliest]) {
+				earliest = i;
+			}
+		}
+		else if (free_mshr < 0) {
+			free_mshr = i;
+		}
+	}
+
+	if (!miss) {
+		T->total_latency += latency;
+		done = T->cycle + latency;
+		if (done > T->last_done) T->last_done = done;
+		return;
+	}
+
+	T->primary_misses++;
+	if (free_mshr < 0) {
+		// every MSHR is busy, issue waits for the first one to finish
+		T->mshr_full++;
+		T->stall_cycles += T->mshr_done[earliest] - T->cycle;
+		T->cycle = T->mshr_done[earliest];
+		free_mshr = earliest;
+	}
+
+	done = T->cycle + latency;
+	T->mshr_block[free_mshr] = block;
+	T->mshr_done[free_mshr] = done;
+	T->total_latency += latency;
+	if (done > T->last_done) T->last_done = done;
+}
+
+void timing_print_results(struct timing_t *T, FILE *file_results)
+{
+	unsigned long long total = (T->last_done > T->cycle) ? T->last_done : T->cycle;
+	double amat = T->accesses ? (double)T->total_latency / (double)T->accesses : 0;
+
+	printf("\nMSHRs: %d", T->nmshrs);
+	fprintf(file_results, "\nMSHRs: %d", T->nmshrs);
+	printf("\nAMAT: %.3f CYCLES", amat);
+	fprintf(file_results, "\nAMAT: %.3f CYCLES", amat);
+	printf("\nTotal Cycles: %llu", total);
+	fprintf(file_results, "\nTotal Cycles: %llu", total);
+	printf("\nPrimary Misses: %llu", T->primary_misses);
+	fprintf(file_results, "\nPrimary Misses: %llu", T->primary_misses);
+	printf("\nSecondary Misses (merged): %llu", T->secondary_misses);
+	fprintf(file_results, "\nSecondary Misses (merged): %llu", T->secondary_misses);
+	printf("\nMSHR Full Events: %llu", T->mshr_full);
+	fprintf(file_results, "\nMSHR Full Events: %llu", T->mshr_full);
+	printf("\nMSHR Stall Cycles: %llu", T->stall_cycles);
+	fprintf(file_results, "\nMSHR Stall Cycles: %llu", T->stall_cycles);
+}
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef __TLB_H__
+#define __TLB_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Address translation in front of the data cache.
+// Every load/store first looks up its page in an L1 TLB, then (on a miss) in an
+// optional L2 TLB; a miss in both walks the page table. Both TLBs are
+// set-associative with LRU replacement, and a walk fills both.
+//
+// The page table is an x86-64 style radix tree of 4 KB tables with 512 8-byte
+// entries, indexed by 9 bits of the virtual address per level. A walk reads one
+// entry per level from the root down, 4 for 4 KB pages, 3 for 2 MB pages and 2 for
+// 1 GB pages, and each read goes through the data cache like any other load, so
+// page-table entries compete with data for the cache. Tables are placed above the
+// 4 GB the trace addresses can reach (TLB_PAGE_TABLE_BASE), one after the other in
+// the order the walks first need them.
+//
+// Trace addresses are used as both virtual and physical addresses: translation adds
+// the lookups and walks, it does not move the data.
+//
+// With set sampling, walk references stay out of the sampled demand counts (like
+// prefetch fills), and the walk's cache statistics come from the references that
+// fell in a sampled set, scaled up to all of them.
+//
+//     -tlb <L1 entries>:<L1 ways>[,<L2 entries>:<L2 ways>][,4k|2m|1g]
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+#include "writebuf.h"
+
+#define TLB_PAGE_TABLE_BASE 0x100000000ULL
+#define TLB_TABLE_BITS 9        // entries per table: 512
+#define TLB_ENTRY_SIZE 8
+
+struct tlb_level {
+	int entries;
+	int assoc;
+	int nsets;
+	unsigned long long *pages;      // page number + 1 per entry, 0 when empty
+	unsigned long long *used;       // last use per entry, for LRU
+
+	unsigned long long accesses;
+	unsigned long long misses;
+};
+
+struct tlb_t {
+	struct cache_t *cp;
+	struct writebuf_t *writebuf;    // memory traffic of the walks, NULL when not kept
+	int page_bits;                  // 12, 21 or 30
+	int walk_levels;                // page-table levels read by a walk
+	int nlevels;                    // 1 or 2 TLBs
+	struct tlb_level levels[2];
+	unsigned long long clock;
+
+	// page-table pages, numbered the first time a walk reaches them
+	unsigned long long *table_keys; // (prefix << 3 | level) + 1, 0 marks an empty slot
+	unsigned long long *table_ids;
+	unsigned long long table_cap;
+	unsigned long long ntables;
+
+	unsigned long long walks;
+	unsigned long long walk_refs;       // page-table entries read
+	unsigned long long walk_sampled;    // of those, references that fell in a simulated set
+	unsigned long long walk_misses;     // of those, misses in the data cache
+	unsigned long long walk_writebacks; // dirty data blocks written back to make room for entries
+	unsigned long long walk_evictions;  // data blocks replaced by page-table entries
+};
+
+// Creates one TLB level. Returns 0 unless entries/assoc is a power of 2.
+int tlb_level_init(struct tlb_level *L, int entries, int assoc)
+{
+	if (entries <= 0 || assoc <= 0 || entries % assoc != 0) {
+		return 0;
+	}
+	L->entries = entries;
+	L->assoc = assoc;
+	L->nsets = entries / assoc;
+	if (L->nsets != (L->nsets & -L->nsets)) {
+		return 0;
+	}
+	L->pages = (unsigned long long *)calloc(entries, sizeof(unsigned long long));
+	L->used = (unsigned long long *)calloc(entries, sizeof(unsigned long long));
+	return 1;
+}
+
+// Parses the -tlb spec and puts the TLBs in front of cp. Returns NULL on a bad spec.
+struct tlb_t * tlb_create(struct cache_t *cp, const char *spec)
+{
+	struct tlb_t *T = (struct tlb_t *)calloc(1, sizeof(struct tlb_t));
+	int e1, a1, e2 = 0, a2 = 0, n;
+	char page[8] = "4k";
+	const char *p;
+
+	n = sscanf(spec, "%d:%d", &e1, &a1);
+	if (n != 2 || !tlb_level_init(&T->levels[0], e1, a1)) {
+		free(T);
+		return NULL;
+	}
+	T->nlevels = 1;
+	p = strchr(spec, ',');
+	if (p && sscanf(p + 1, "%d:%d", &e2, &a2) == 2) {
+		if (!tlb_level_init(&T->levels[1], e2, a2)) {
+			free(T);
+			return NULL;
+		}
+		T->nlevels = 2;
+		p = strchr(p + 1, ',');
+	}
+	if (p && sscanf(p + 1, "%7s", page) != 1) {
+		free(T);
+		return NULL;
+	}
+
+	if (strcmp(page, "4k") == 0) T->page_bits = 12;
+	else if (strcmp(page, "2m") == 0) T->page_bits = 21;
+	else if (strcmp(page, "1g") == 0) T->page_bits = 30;
+	else {
+		free(T);
+		return NULL;
+	}
+	T->walk_levels = 4 - (T->page_bits - 12) / TLB_TABLE_BITS;
+
+	T->cp = cp;
+	T->table_cap = 1024;
+	T->table_keys = (unsigned long long *)calloc(T->table_cap, sizeof(unsigned long long));
+	T->table_ids = (unsigned long long *)malloc(T->table_cap * sizeof(unsigned long long));
+	return T;
+}
+
+// Looks page up in L, refreshing it on a hit. Returns 1 on a hit.
+int tlb_lookup(struct tlb_level *L, unsigned long long page, unsigned long long now)
+{
+	unsigned long long *pages = L->pages + (size_t)(page & (L->nsets - 1)) * L->assoc;
+	int i;
+
+	L->accesses++;
+	for (i = 0; i < L->assoc; i++) {
+		if (pages[i] == page + 1) {
+			L->used[(pages - L->pages) + i] = now;
+			return 1;
+		}
+	}
+	L->misses++;
+	return 0;
+}
+
+// Puts page into L, in an empty way or over the least recently used one
+void tlb_fill(struct tlb_level *L, unsigned long long page, unsigned long long now)
+{
+	size_t base = (size_t)(page & (L->nsets - 1)) * L->assoc;
+	int i, way = 0;
+
+	for (i = 0; i < L->assoc; i++) {
+		if (!L->pages[base + i]) {
+			way = i;
+			break;
+		}
+		if (L->used[base + i] < L->used[base + way]) {
+			way = i;
+		}
+	}
+	L->pages[base + way] = page + 1;
+	L->used[base + way] = now;
+}
+
+static inline unsigned long long tlb_hash(unsigned long long key)
+{
+	return (key * 0x9E3779B97F4A7C15ull) >> 20;
+}
+
+// Returns the number of the table at level (4 = root) that covers addresses starting with prefix
+unsigned long long tlb_table(struct tlb_t *T, int level, unsigned long long prefix)
+{
+	unsigned long long key = ((prefix << 3) | (unsigned long long)level) + 1, h, i, old_cap;
+	unsigned long long *old_keys, *old_ids;
+
+	if ((T->ntables + 1) * 2 > T->table_cap) {
+		old_cap = T->table_cap;
+		old_keys = T->table_keys;
+		old_ids = T->table_ids;
+		T->table_cap = old_cap * 2;
+		T->table_keys = (unsigned long long *)calloc(T->table_cap, sizeof(unsigned long long));
+		T->table_ids = (unsigned long long *)malloc(T->table_cap * sizeof(unsigned long long));
+		for (i = 0; i < old_cap; i++) {
+			if (old_keys[i]) {
+				h = tlb_hash(old_keys[i]) & (T->table_cap - 1);
+				while (T->table_keys[h]) {
+					h = (h + 1) & (T->table_cap - 1);
+				}
+				T->table_keys[h] = old_keys[i];
+				T->table_ids[h] = old_ids[i];
+			}
+		}
+		free(old_keys);
+		free(old_ids);
+	}
+
+	h = tlb_hash(key) & (T->table_cap - 1);
+	while (T->table_keys[h] && T->table_keys[h] != key) {
+		h = (h + 1) & (T->table_cap - 1);
+	}
+	if (!T->table_keys[h]) {
+		T->table_keys[h] = key;
+		T->table_ids[h] = T->ntables;
+		T->ntables++;
+	}
+	return T->table_ids[h];
+}
+
+// Reads the page-table entries that map address through the data cache, one logical tick each
+void tlb_walk(struct tlb_t *T, unsigned long address, unsigned long long *now)
+{
+	struct cache_t *cp = T->cp;
+	unsigned long long *sample_counts = cp->sample_counts;
+	unsigned long long va = address, entry;
+	int level, shift, status;
+
+	T->walks++;
+	for (level = 4; level > 4 - T->walk_levels; level--) {
+		shift = 12 + TLB_TABLE_BITS * (level - 1);
+		entry = TLB_PAGE_TABLE_BASE + tlb_table(T, level, va >> (shift + TLB_TABLE_BITS)) * (TLB_ENTRY_SIZE << TLB_TABLE_BITS)
+			+ ((va >> shift) & ((1ULL << TLB_TABLE_BITS) - 1)) * TLB_ENTRY_SIZE;
+
+		// walk references are not demand accesses, keep them out of the sampled counts
+		*now = *now + 1;
+		cp->sample_counts = NULL;
+		status = cache_access(cp, (unsigned long)entry, ti_LOAD, NULL, 0, *now);
+		cp->sample_counts = sample_counts;
+		T->walk_refs++;
+		if (status == CACHE_NOT_SAMPLED) {
+			continue;
+		}
+		T->walk_sampled++;
+		if (T->writebuf) {
+			writebuf_fill(T->writebuf, status);
+		}
+		if (status == 1 || status == 2) {
+			T->walk_misses++;
+		}
+		if (cp->evicted && cp->evicted_address < TLB_PAGE_TABLE_BASE) {
+			T->walk_evictions++;
+		}
+		if (status == 2) {
+			T->walk_writebacks++;
+		}
+	}
+}
+
+// Translates the address of a load/store before it goes to the cache; *now advances for every walk reference
+void tlb_access(struct tlb_t *T, unsigned long address, unsigned long long *now)
+{
+	unsigned long long page = (unsigned long long)address >> T->page_bits;
+
+	T->clock++;
+	if (tlb_lookup(&T->levels[0], page, T->clock)) {
+		return;
+	}
+	if (T->nlevels == 2 && tlb_lookup(&T->levels[1], page, T->clock)) {
+		tlb_fill(&T->levels[0], page, T->clock);
+		return;
+	}
+	tlb_walk(T, address, now);
+	if (T->nlevels == 2) {
+		tlb_fill(&T->levels[1], page, T->clock);
+	}
+	tlb_fill(&T->levels[0], page, T->clock);
+}
+
+// Zeroes the TLB and walk counts, keeping the TLB contents and page tables (end of a warmup)
+void tlb_clear_stats(struct tlb_t *T)
+{
+	int l;
+
+	for (l = 0; l < T->nlevels; l++) {
+		T->levels[l].accesses = 0;
+		T->levels[l].misses = 0;
+	}
+	T->walks = 0;
+	T->walk_refs = 0;
+	T->walk_sampled = 0;
+	T->walk_misses = 0;
+	T->walk_writebacks = 0;
+	T->walk_evictions = 0;
+}
+
+void tlb_print_results(struct tlb_t *T, FILE *file_results)
+{
+	struct tlb_level *L;
+	int l;
+
+	printf("\n\nPage Size: %s", T->page_bits == 12 ? "4 KBYTES" : T->page_bits == 21 ? "2 MBYTES" : "1 GBYTES");
+	fprintf(file_results, "\n\nPage Size: %s", T->page_bits == 12 ? "4 KBYTES" : T->page_bits == 21 ? "2 MBYTES" : "1 GBYTES");
+	for (l = 0; l < T->nlevels; l++) {
+		L = &T->levels[l];
+		printf("\nL%d TLB: %d entries, %d-way", l + 1, L->entries, L->assoc);
+		fprintf(file_results, "\nL%d TLB: %d entries, %d-way", l + 1, L->entries, L->assoc);
+		printf("\nL%d TLB Accesses: %llu", l + 1, L->accesses);
+		fprintf(file_results, "\nL%d TLB Accesses: %llu", l + 1, L->accesses);
+		printf("\nL%d TLB Misses: %llu (%.4f%%)", l + 1, L->misses, L->accesses ? 100.0 * (double)L->misses / (double)L->accesses : 0.0);
+		fprintf(file_results, "\nL%d TLB Misses: %llu (%.4f%%)", l + 1, L->misses, L->accesses ? 100.0 * (double)L->misses / (double)L->accesses : 0.0);
+	}
+	printf("\nPage Walks: %llu", T->walks);
+	fprintf(file_results, "\nPage Walks: %llu", T->walks);
+	printf("\nPage Tables: %llu", T->ntables);
+	fprintf(file_results, "\nPage Tables: %llu", T->ntables);
+	printf("\nPage Walk References: %llu", T->walk_refs);
+	fprintf(file_results, "\nPage Walk References: %llu", T->walk_refs);
+	if (T->cp->sample_counts) {
+		double scale = T->walk_sampled ? (double)T->walk_refs / (double)T->walk_sampled : 0.0;
+
+		printf("\nPage Walk Cache Misses: %.0f (estimated)", (double)T->walk_misses * scale);
+		fprintf(file_results, "\nPage Walk Cache Misses: %.0f (estimated)", (double)T->walk_misses * scale);
+		printf("\nData Blocks Evicted by Walks: %.0f (estimated)", (double)T->walk_evictions * scale);
+		fprintf(file_results, "\nData Blocks Evicted by Walks: %.0f (estimated)", (double)T->walk_evictions * scale);
+		printf("\nPage Walk Writebacks: %.0f (estimated)", (double)T->walk_writebacks * scale);
+		fprintf(file_results, "\nPage Walk Writebacks: %.0f (estimated)", (double)T->walk_writebacks * scale);
+		return;
+	}
+	printf("\nPage Walk Cache Misses: %llu", T->walk_misses);
+	fprintf(file_results, "\nPage Walk Cache Misses: %llu", T->walk_misses);
+	printf("\nData Blocks Evicted by Walks: %llu", T->walk_evictions);
+	fprintf(file_results, "\nData Blocks Evicted by Walks: %llu", T->walk_evictions);
+	printf("\nPage Walk Writebacks: %llu", T->walk_writebacks);
+	fprintf(file_results, "\nPage Walk Writebacks: %llu", T->walk_writebacks);
+}
+
+#endif
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+//
+// Converts a raw trace to the compact memory-only format (compact_trace.h), or back.
+//
+//     trace_convert [-pc] <trace_file> <output.mtr>    keep loads/stores (and their PCs with -pc)
+//     trace_convert -raw <input.mtr> <trace_file>      expand a compact trace to trace_items
+//
+// Build: gcc -O2 -pthread -o trace_convert trace_convert.c -lz
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define _FILE_OFFSET_BITS 64 //traces and logs larger than 2 GB on 32-bit hosts
+#define _GNU_SOURCE //fopencookie, for compressed traces
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_item.h"
+#include "compact_trace.h"
+#include "trace_reader.h"
+
+int main(int argc, char **argv)
+{
+	struct trace_reader_t *reader;
+	const struct trace_item *tr_entry;
+	struct mtr_writer *writer;
+	FILE *out;
+	unsigned int flags = 0;
+	int to_raw = 0, arg = 1;
+	unsigned long long records = 0, kept = 0, out_bytes;
+
+	while (arg < argc && argv[arg][0] == '-') {
+		if (strcmp(argv[arg], "-pc") == 0) {
+			flags |= MTR_FLAG_PC;
+		}
+		else if (strcmp(argv[arg], "-raw") == 0) {
+			to_raw = 1;
+		}
+		else {
+			break;
+		}
+		arg++;
+	}
+
+	if (argc - arg != 2) {
+		fprintf(stdout, "\nUSAGE: trace_convert [-pc] <trace_file> <output.mtr>\n");
+		fprintf(stdout, "       trace_convert -raw <input.mtr> <trace_file>\n\n");
+		exit(0);
+	}
+
+	reader = trace_reader_open(argv[arg], TRACE_READER_THREAD);
+	if (!reader) {
+		fprintf(stdout, "\ntrace file %s not opened.\n\n", argv[arg]);
+		exit(0);
+	}
+
+	if (to_raw) {
+		out = fopen(argv[arg + 1], "wb");
+		if (!out) {
+			fprintf(stdout, "\noutput file %s not opened.\n\n", argv[arg + 1]);
+			exit(0);
+		}
+		while (trace_reader_next(reader, &tr_entry)) {
+			fwrite(tr_entry, sizeof(struct trace_item), 1, out);
+			records++;
+		}
+		fclose(out);
+		trace_reader_close(reader);
+		fprintf(stdout, "\nRecords: %llu\nOutput: %llu BYTES\n", records, records * sizeof(struct trace_item));
+		exit(0);
+	}
+
+	writer = mtr_writer_open(argv[arg + 1], flags);
+	if (!writer) {
+		fprintf(stdout, "\noutput file %s not opened.\n\n", argv[arg + 1]);
+		exit(0);
+	}
+	while (trace_reader_next(reader, &tr_entry)) {
+		kept += mtr_writer_add(writer, tr_entry);
+		records++;
+	}
+	out_bytes = mtr_writer_close(writer);
+	trace_reader_close(reader);
+
+	fprintf(stdout, "\nRecords: %llu", records);
+	fprintf(stdout, "\nMemory Records Kept: %llu", kept);
+	fprintf(stdout, "\nInput: %llu BYTES", records * sizeof(struct trace_item));
+	fprintf(stdout, "\nOutput: %llu BYTES", out_bytes);
+	if (out_bytes) {
+		fprintf(stdout, "\nRatio: %.2fx", (double)(records * sizeof(struct trace_item)) / (double)out_bytes);
+	}
+	fprintf(stdout, "\n");
+
+	exit(0);
+}
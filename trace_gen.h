@@ -0,0 +1,154 @@
+#ifndef __TRACE_GEN_H__
+#define __TRACE_GEN_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Synthetic trace generators.
+// Each generator fills an array of trace_items with loads and stores that touch a
+// footprint of the given size, starting at TRACE_GEN_BASE:
+//
+//   sequential - consecutive words, wrapping at the end of the footprint
+//   strided    - one word every stride bytes, wrapping
+//   random     - uniformly random words
+//   zipf       - blocks picked with a Zipf distribution (block k has weight 1/k^s)
+//   chase      - pointer chasing through a random cycle over every block; loads only
+//
+// Every fourth access of the other patterns is a store. The random streams use a
+// fixed seed, so a generator always produces the same trace.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "trace_item.h"
+
+#define TRACE_GEN_BASE 0x10000000u
+#define TRACE_GEN_WORD 4
+#define TRACE_GEN_BLOCK 64           // granularity of the zipf and chase patterns
+#define TRACE_GEN_STORE_ONE_IN 4
+
+enum trace_gen_pattern {
+	TRACE_GEN_SEQUENTIAL,
+	TRACE_GEN_STRIDED,
+	TRACE_GEN_RANDOM,
+	TRACE_GEN_ZIPF,
+	TRACE_GEN_CHASE
+};
+
+#define TRACE_GEN_NPATTERNS 5
+
+char *trace_gen_names[TRACE_GEN_NPATTERNS] = { "sequential", "strided", "random", "zipf", "chase" };
+
+struct trace_gen_params {
+	unsigned int footprint;   // bytes touched, a multiple of TRACE_GEN_BLOCK
+	unsigned int stride;      // bytes, for strided
+	double zipf_s;            // exponent, for zipf
+};
+
+// xorshift64
+static inline unsigned long long trace_gen_random(unsigned long long *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+// Returns the pattern with the given name, or -1
+int trace_gen_from_name(const char *name)
+{
+	int i;
+
+	for (i = 0; i < TRACE_GEN_NPATTERNS; i++) {
+		if (strcmp(name, trace_gen_names[i]) == 0) return i;
+	}
+	return -1;
+}
+
+static inline void trace_gen_item(struct trace_item *item, unsigned int address, unsigned char type)
+{
+	item->type = type;
+	item->sReg_a = 0;
+	item->sReg_b = 0;
+	item->dReg = 0;
+	item->PC = 0;
+	item->Addr = address;
+}
+
+// Fills items[0..n) with the pattern
+void trace_gen_fill(enum trace_gen_pattern pattern, const struct trace_gen_params *params, struct trace_item *items, size_t n)
+{
+	unsigned long long rng = 0x9E3779B97F4A7C15ULL; // fixed seed so traces are repeatable
+	unsigned int footprint = params->footprint;
+	unsigned int nblocks = footprint / TRACE_GEN_BLOCK;
+	unsigned int nwords = footprint / TRACE_GEN_WORD;
+	unsigned int offset = 0, k, j;
+	unsigned int *next;
+	double *cdf, u, sum;
+	size_t i;
+
+	switch (pattern) {
+		case TRACE_GEN_SEQUENTIAL:
+		case TRACE_GEN_STRIDED:
+			for (i = 0; i < n; i++) {
+				trace_gen_item(&items[i], TRACE_GEN_BASE + offset, (i % TRACE_GEN_STORE_ONE_IN == TRACE_GEN_STORE_ONE_IN - 1) ? ti_STORE : ti_LOAD);
+				offset += (pattern == TRACE_GEN_SEQUENTIAL) ? TRACE_GEN_WORD : params->stride;
+				if (offset >= footprint) offset -= footprint;
+			}
+			break;
+
+		case TRACE_GEN_RANDOM:
+			for (i = 0; i < n; i++) {
+				offset = (unsigned int)(trace_gen_random(&rng) % nwords) * TRACE_GEN_WORD;
+				trace_gen_item(&items[i], TRACE_GEN_BASE + offset, (i % TRACE_GEN_STORE_ONE_IN == TRACE_GEN_STORE_ONE_IN - 1) ? ti_STORE : ti_LOAD);
+			}
+			break;
+
+		case TRACE_GEN_ZIPF:
+			// inverse transform sampling over the cumulative weights
+			cdf = (double *)malloc(nblocks * sizeof(double));
+			sum = 0;
+			for (k = 0; k < nblocks; k++) {
+				sum += 1.0 / pow((double)(k + 1), params->zipf_s);
+				cdf[k] = sum;
+			}
+			for (i = 0; i < n; i++) {
+				u = (double)(trace_gen_random(&rng) >> 11) / 9007199254740992.0 * sum;
+				k = 0;
+				j = nblocks - 1;
+				while (k < j) {
+					unsigned int mid = k + (j - k) / 2;
+					if (cdf[mid] < u) k = mid + 1;
+					else j = mid;
+				}
+				// scatter the ranks so popular blocks do not all share a few sets
+				offset = (unsigned int)(((unsigned long long)k * 2654435761u) % nblocks) * TRACE_GEN_BLOCK;
+				trace_gen_item(&items[i], TRACE_GEN_BASE + offset, (i % TRACE_GEN_STORE_ONE_IN == TRACE_GEN_STORE_ONE_IN - 1) ? ti_STORE : ti_LOAD);
+			}
+			free(cdf);
+			break;
+
+		case TRACE_GEN_CHASE:
+			// Sattolo's shuffle gives a single cycle through every block
+			next = (unsigned int *)malloc(nblocks * sizeof(unsigned int));
+			for (k = 0; k < nblocks; k++) next[k] = k;
+			for (k = nblocks - 1; k > 0; k--) {
+				unsigned int t;
+				j = (unsigned int)(trace_gen_random(&rng) % k);
+				t = next[k];
+				next[k] = next[j];
+				next[j] = t;
+			}
+			k = 0;
+			for (i = 0; i < n; i++) {
+				trace_gen_item(&items[i], TRACE_GEN_BASE + k * TRACE_GEN_BLOCK, ti_LOAD);
+				k = next[k];
+			}
+			free(next);
+			break;
+	}
+}
+
+#endif
@@ -0,0 +1,322 @@
+#ifndef __TRACE_READER_H__
+#define __TRACE_READER_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Trace reader backends. All of them hand out pointers to records that stay valid
+// until the next call to trace_reader_next.
+//
+//   fread  - copies the file in TRACE_BUFSIZE-record chunks (the original reader)
+//   mmap   - maps the whole file and returns records straight from the mapping,
+//            advising the kernel of sequential access and prefetching a window ahead
+//   thread - a producer thread fills a ring of chunks while the simulator consumes
+//            them, so file reads overlap with simulation
+//
+// mmap falls back to fread for inputs that cannot be mapped (pipes, empty files).
+// Compact .mtr traces (see compact_trace.h) are detected from their header and
+// decoded block by block wherever the raw format would be read with fread.
+// gzip and zstd traces (see compressed_trace.h) of either format are decompressed as
+// they are read; with mmap they are read by the thread backend instead, so the
+// producer thread decompresses while the simulator consumes.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace_item.h"
+#include "compact_trace.h"
+#include "compressed_trace.h"
+
+#define TRACE_BUFSIZE 1024*1024
+#define TRACE_RING_CHUNKS 4
+#define TRACE_MMAP_WINDOW (64UL*1024*1024) // bytes prefetched ahead of the reader
+
+enum trace_reader_mode {
+	TRACE_READER_FREAD,
+	TRACE_READER_MMAP,
+	TRACE_READER_THREAD
+};
+
+struct trace_chunk {
+	struct trace_item *items;
+	int n_items;     // 0 marks the end of the trace
+	int full;        // set by the producer, cleared by the consumer
+};
+
+struct trace_reader_t {
+	enum trace_reader_mode mode;
+	FILE *fd;
+	int compact;              // the file is in the compact .mtr format
+	enum compressed_format compressed;  // fd decompresses the file as it is read
+	struct mtr_reader mtr;
+
+	// fread and thread: the chunk being consumed
+	struct trace_item *buf;
+	size_t buf_ptr;
+	size_t buf_end;
+
+	// mmap
+	const struct trace_item *map;
+	size_t map_bytes;
+	size_t map_items;
+	size_t map_ptr;
+	size_t map_advised;   // bytes already passed to MADV_WILLNEED
+
+	// thread
+	pthread_t producer;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+	struct trace_chunk ring[TRACE_RING_CHUNKS];
+	int ring_head;        // next chunk the consumer takes
+	int stop;             // asks the producer to quit early
+	int eof;
+};
+
+// Reads up to TRACE_BUFSIZE records into items. Returns the number read, 0 at the end of the trace.
+int trace_reader_fill(struct trace_reader_t *R, struct trace_item *items)
+{
+	int n_items = 0, n_block;
+
+	if (!R->compact) {
+		return fread(items, sizeof(struct trace_item), TRACE_BUFSIZE, R->fd);
+	}
+
+	while (n_items + MTR_BLOCK_RECORDS <= TRACE_BUFSIZE) {
+		n_block = mtr_reader_next_block(R->fd, &R->mtr, items + n_items);
+		if (!n_block) break;
+		n_items += n_block;
+	}
+	return n_items;
+}
+
+void * trace_reader_produce(void *arg)
+{
+	struct trace_reader_t *R = (struct trace_reader_t *)arg;
+	int tail = 0, n_items;
+
+	while (1) {
+		struct trace_chunk *chunk = &R->ring[tail];
+
+		pthread_mutex_lock(&R->lock);
+		while (chunk->full && !R->stop) {
+			pthread_cond_wait(&R->drained, &R->lock);
+		}
+		if (R->stop) {
+			pthread_mutex_unlock(&R->lock);
+			break;
+		}
+		pthread_mutex_unlock(&R->lock);
+
+		// the chunk is ours until it is marked full
+		n_items = trace_reader_fill(R, chunk->items);
+
+		pthread_mutex_lock(&R->lock);
+		chunk->n_items = n_items;
+		chunk->full = 1;
+		pthread_cond_signal(&R->filled);
+		pthread_mutex_unlock(&R->lock);
+
+		if (!n_items) break;
+		tail = (tail + 1) % TRACE_RING_CHUNKS;
+	}
+
+	return NULL;
+}
+
+int trace_reader_map(struct trace_reader_t *R)
+{
+	struct stat st;
+	void *map;
+
+	// files that do not fit in the address space (on 32-bit hosts) are read with fread instead
+	if (fstat(fileno(R->fd), &st) || !S_ISREG(st.st_mode) || st.st_size < (off_t)sizeof(struct trace_item)
+		|| (unsigned long long)st.st_size > (unsigned long long)(size_t)-1) {
+		return 0;
+	}
+
+	map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(R->fd), 0);
+	if (map == MAP_FAILED) {
+		return 0;
+	}
+	madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	R->map = (const struct trace_item *)map;
+	R->map_bytes = (size_t)st.st_size;
+	R->map_items = R->map_bytes / sizeof(struct trace_item);
+	R->map_ptr = 0;
+	R->map_advised = 0;
+	return 1;
+}
+
+// Opens a trace file with the given backend. Returns NULL if the file cannot be opened.
+struct trace_reader_t * trace_reader_open(char *trace_file_name, enum trace_reader_mode mode)
+{
+	struct trace_reader_t *R;
+	int i;
+
+	R = (struct trace_reader_t *)calloc(1, sizeof(struct trace_reader_t));
+	R->fd = fopen(trace_file_name, "rb");
+	if (!R->fd) {
+		free(R);
+		return NULL;
+	}
+
+	R->compressed = compressed_detect(R->fd);
+	if (R->compressed != COMPRESSED_NONE) {
+		FILE *stream = compressed_open(R->fd, R->compressed);
+		if (!stream) {
+			fprintf(stdout, "\n%s is %s compressed and this build cannot read it.\n", trace_file_name, compressed_format_names[R->compressed]);
+			fclose(R->fd);
+			free(R);
+			return NULL;
+		}
+		R->fd = stream;
+	}
+
+	if (mtr_detect(R->fd)) {
+		if (!mtr_reader_open(R->fd, &R->mtr)) {
+			fclose(R->fd);
+			free(R);
+			return NULL;
+		}
+		R->compact = 1;
+	}
+
+	// compressed traces cannot be mapped: decompress them on the producer thread instead
+	if (mode == TRACE_READER_MMAP && R->compressed != COMPRESSED_NONE) {
+		mode = TRACE_READER_THREAD;
+	}
+	// compact traces have to be decoded, so there is nothing to gain from mapping them
+	if (mode == TRACE_READER_MMAP && (R->compact || !trace_reader_map(R))) {
+		mode = TRACE_READER_FREAD;
+	}
+	R->mode = mode;
+
+	if (mode == TRACE_READER_FREAD) {
+		R->buf = (struct trace_item *)malloc(sizeof(struct trace_item) * TRACE_BUFSIZE);
+		if (!R->buf) {
+			fprintf(stdout, "** trace_buf not allocated\n");
+			exit(-1);
+		}
+	}
+	else if (mode == TRACE_READER_THREAD) {
+		for (i = 0; i < TRACE_RING_CHUNKS; i++) {
+			R->ring[i].items = (struct trace_item *)malloc(sizeof(struct trace_item) * TRACE_BUFSIZE);
+			if (!R->ring[i].items) {
+				fprintf(stdout, "** trace_buf not allocated\n");
+				exit(-1);
+			}
+		}
+		R->ring_head = -1; // nothing taken yet
+		pthread_mutex_init(&R->lock, NULL);
+		pthread_cond_init(&R->filled, NULL);
+		pthread_cond_init(&R->drained, NULL);
+		pthread_create(&R->producer, NULL, trace_reader_produce, R);
+	}
+
+	return R;
+}
+
+// Hands out the next record. Returns 0 at the end of the trace, and keeps returning 0 after it.
+int trace_reader_next(struct trace_reader_t *R, const struct trace_item **item)
+{
+	if (R->mode == TRACE_READER_MMAP) {
+		if (R->map_ptr == R->map_items) return 0;
+
+		// keep a window of the file in flight ahead of the reader
+		if (R->map_ptr * sizeof(struct trace_item) >= R->map_advised) {
+			size_t start = R->map_advised & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+			size_t len = TRACE_MMAP_WINDOW;
+			if (start + len > R->map_bytes) len = R->map_bytes - start;
+			madvise((char *)R->map + start, len, MADV_WILLNEED);
+			R->map_advised = start + len;
+		}
+
+		*item = &R->map[R->map_ptr];
+		R->map_ptr++;
+		return 1;
+	}
+
+	if (R->buf_ptr == R->buf_end) {
+		if (R->mode == TRACE_READER_FREAD) {
+			// get new data
+			R->buf_end = trace_reader_fill(R, R->buf);
+		}
+		else {
+			if (R->eof) return 0;
+
+			// hand the drained chunk back to the producer and wait for the next one
+			pthread_mutex_lock(&R->lock);
+			if (R->ring_head >= 0) {
+				R->ring[R->ring_head].full = 0;
+				pthread_cond_signal(&R->drained);
+			}
+			R->ring_head = (R->ring_head + 1) % TRACE_RING_CHUNKS;
+			while (!R->ring[R->ring_head].full) {
+				pthread_cond_wait(&R->filled, &R->lock);
+			}
+			pthread_mutex_unlock(&R->lock);
+
+			R->buf = R->ring[R->ring_head].items;
+			R->buf_end = R->ring[R->ring_head].n_items;
+			if (!R->buf_end) R->eof = 1;
+		}
+		R->buf_ptr = 0; //so a call after the end finds the buffer empty again
+		if (!R->buf_end) return 0;
+	}
+
+	*item = &R->buf[R->buf_ptr];
+	R->buf_ptr++;
+
+	return 1;
+}
+
+void trace_reader_close(struct trace_reader_t *R)
+{
+	int i;
+
+	if (R->mode == TRACE_READER_MMAP) {
+		munmap((void *)R->map, R->map_bytes);
+	}
+	else if (R->mode == TRACE_READER_FREAD) {
+		free(R->buf);
+	}
+	else {
+		pthread_mutex_lock(&R->lock);
+		R->stop = 1;
+		pthread_cond_signal(&R->drained);
+		pthread_mutex_unlock(&R->lock);
+		pthread_join(R->producer, NULL);
+
+		for (i = 0; i < TRACE_RING_CHUNKS; i++) {
+			free(R->ring[i].items);
+		}
+		pthread_mutex_destroy(&R->lock);
+		pthread_cond_destroy(&R->filled);
+		pthread_cond_destroy(&R->drained);
+	}
+
+	if (R->compact) {
+		mtr_reader_close(&R->mtr);
+	}
+	fclose(R->fd);
+	free(R);
+}
+
+// Parses a -reader argument. Returns -1 for an unknown backend.
+int trace_reader_mode_from_name(char *name)
+{
+	if (strcmp(name, "fread") == 0) return TRACE_READER_FREAD;
+	if (strcmp(name, "mmap") == 0) return TRACE_READER_MMAP;
+	if (strcmp(name, "thread") == 0) return TRACE_READER_THREAD;
+	return -1;
+}
+
+#endif
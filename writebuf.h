@@ -0,0 +1,211 @@
+#ifndef __WRITEBUF_H__
+#define __WRITEBUF_H__
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Memory traffic and the coalescing write buffer.
+// Every block fill reads a whole block from memory, whether a demand miss, a prefetch
+// or a page-walk reference caused it (writebuf_fill). Writes to memory go through a
+// FIFO buffer of whole-block entries, each with a mask of the words written:
+//   - a dirty victim enters with every word set
+//   - a store that reaches memory (any store under write-through, a store miss under
+//     no-write-allocate) enters with its own word set
+// A write to a block that already has an entry is merged into it. The oldest entry
+// is written to memory when room is needed, once every drain_every accesses (if not
+// 0), and at the end of the run; each of those is one write transaction carrying
+// only the words that were written. With no entries every write is its own transaction.
+//
+// The trace does not record access sizes, so every store is taken to write one word.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "trace_item.h"
+#include "skeleton.h"
+
+#define WRITEBUF_WORD 4   // bytes written by one store
+
+struct writebuf_t {
+	struct cache_t *cp;
+	int nentries;
+	int drain_every;              // accesses between background drains, 0 for none
+	int block_words;              // words per block (at least one)
+	int mask_words;               // 64-bit words of the per-entry word mask
+	unsigned long long *scratch;  // mask of the write being queued
+
+	int n;                        // entries in use
+	int head;                     // oldest entry
+	unsigned long *blocks;
+	unsigned long long *masks;    // nentries * mask_words
+	unsigned long long since_drain;
+
+	unsigned long long read_bytes;
+	unsigned long long write_bytes;
+	unsigned long long write_transactions;
+	unsigned long long memory_stores;  // stores that had to reach memory
+	unsigned long long coalesced;      // writes merged into an entry already in the buffer
+	unsigned long long full_drains;    // entries written out because the buffer was full
+};
+
+// Creates the traffic counters for cp with a buffer of nentries (0 for none)
+struct writebuf_t * writebuf_create(struct cache_t *cp, int nentries, int drain_every)
+{
+	struct writebuf_t *W = (struct writebuf_t *)calloc(1, sizeof(struct writebuf_t));
+
+	W->cp = cp;
+	W->nentries = nentries;
+	W->drain_every = drain_every;
+	W->block_words = (cp->bsize > WRITEBUF_WORD) ? cp->bsize / WRITEBUF_WORD : 1;
+	W->mask_words = (W->block_words + 63) / 64;
+	W->scratch = (unsigned long long *)calloc(W->mask_words, sizeof(unsigned long long));
+	W->blocks = (unsigned long *)calloc(nentries > 0 ? nentries : 1, sizeof(unsigned long));
+	W->masks = (unsigned long long *)calloc((size_t)(nentries > 0 ? nentries : 1) * W->mask_words, sizeof(unsigned long long));
+	return W;
+}
+
+// Sends the words in mask to memory as one transaction
+void writebuf_transaction(struct writebuf_t *W, const unsigned long long *mask)
+{
+	int i, words = 0;
+
+	for (i = 0; i < W->mask_words; i++) {
+		words += __builtin_popcountll(mask[i]);
+	}
+	W->write_bytes += (unsigned long long)words * WRITEBUF_WORD;
+	W->write_transactions++;
+}
+
+// Writes the oldest entry to memory
+void writebuf_drain(struct writebuf_t *W)
+{
+	writebuf_transaction(W, &W->masks[(size_t)W->head * W->mask_words]);
+	W->head = (W->head + 1) % W->nentries;
+	W->n--;
+}
+
+// Queues a write of the words in mask of block
+void writebuf_write(struct writebuf_t *W, unsigned long block, const unsigned long long *mask)
+{
+	int i, j, e;
+
+	if (W->nentries == 0) {
+		writebuf_transaction(W, mask);
+		return;
+	}
+
+	for (i = 0; i < W->n; i++) {
+		e = (W->head + i) % W->nentries;
+		if (W->blocks[e] == block) {
+			for (j = 0; j < W->mask_words; j++) {
+				W->masks[(size_t)e * W->mask_words + j] |= mask[j];
+			}
+			W->coalesced++;
+			return;
+		}
+	}
+
+	if (W->n == W->nentries) {
+		writebuf_drain(W);
+		W->full_drains++;
+	}
+	e = (W->head + W->n) % W->nentries;
+	W->blocks[e] = block;
+	memcpy(&W->masks[(size_t)e * W->mask_words], mask, W->mask_words * sizeof(unsigned long long));
+	W->n++;
+}
+
+// Queues the write of the whole dirty block cache_access just evicted
+void writebuf_victim(struct writebuf_t *W)
+{
+	struct cache_t *cp = W->cp;
+	unsigned long long *mask = W->scratch;
+
+	memset(mask, 0xff, W->mask_words * sizeof(unsigned long long));
+	if (W->block_words & 63) {
+		mask[W->mask_words - 1] = (1ULL << (W->block_words & 63)) - 1;
+	}
+	writebuf_write(W, (unsigned long)(cp->evicted_address >> cp->n_bits_for_block_offset), mask);
+}
+
+// Accounts the memory traffic of the access cache_access just performed; status is what it returned
+void writebuf_access(struct writebuf_t *W, unsigned long address, char access_type, int status)
+{
+	struct cache_t *cp = W->cp;
+	unsigned long long *mask = W->scratch;
+	int word;
+
+	W->since_drain++;
+	if (W->drain_every && W->since_drain >= (unsigned long long)W->drain_every) {
+		W->since_drain = 0;
+		if (W->n) writebuf_drain(W);
+	}
+
+	if (status == CACHE_NOT_SAMPLED) {
+		return;
+	}
+	if (status != 0 && !(access_type == ti_STORE && cp->no_write_allocate)) {
+		W->read_bytes += cp->bsize;
+	}
+	if (cp->evicted == 2) {
+		writebuf_victim(W);
+	}
+	if (access_type == ti_STORE && (cp->write_through || (status != 0 && cp->no_write_allocate))) {
+		memset(mask, 0, W->mask_words * sizeof(unsigned long long));
+		word = (int)((address & (unsigned long)(cp->bsize - 1)) / WRITEBUF_WORD) % W->block_words;
+		mask[word >> 6] = 1ULL << (word & 63);
+		writebuf_write(W, address >> cp->n_bits_for_block_offset, mask);
+		W->memory_stores++;
+	}
+}
+
+// Accounts a fill no demand access asked for (a prefetch, a page-walk reference); status is what cache_access returned
+void writebuf_fill(struct writebuf_t *W, int status)
+{
+	if (status == 0 || status == CACHE_NOT_SAMPLED) {
+		return;
+	}
+	W->read_bytes += W->cp->bsize;
+	if (W->cp->evicted == 2) {
+		writebuf_victim(W);
+	}
+}
+
+// Writes out whatever is still buffered at the end of the run
+void writebuf_finish(struct writebuf_t *W)
+{
+	while (W->n) {
+		writebuf_drain(W);
+	}
+}
+
+void writebuf_print_results(struct writebuf_t *W, FILE *file_results)
+{
+	struct cache_t *cp = W->cp;
+
+	writebuf_finish(W);
+
+	printf("\n\nWrite Policy: %s, %s", cp->write_through ? "WRITE-THROUGH" : "WRITE-BACK", cp->no_write_allocate ? "NO-WRITE-ALLOCATE" : "WRITE-ALLOCATE");
+	fprintf(file_results, "\n\nWrite Policy: %s, %s", cp->write_through ? "WRITE-THROUGH" : "WRITE-BACK", cp->no_write_allocate ? "NO-WRITE-ALLOCATE" : "WRITE-ALLOCATE");
+	printf("\nWrite Buffer: %d entries", W->nentries);
+	fprintf(file_results, "\nWrite Buffer: %d entries", W->nentries);
+	if (W->drain_every) {
+		printf(", one drained every %d accesses", W->drain_every);
+		fprintf(file_results, ", one drained every %d accesses", W->drain_every);
+	}
+	printf("\nMemory Read Traffic: %llu BYTES", W->read_bytes);
+	fprintf(file_results, "\nMemory Read Traffic: %llu BYTES", W->read_bytes);
+	printf("\nMemory Write Traffic: %llu BYTES", W->write_bytes);
+	fprintf(file_results, "\nMemory Write Traffic: %llu BYTES", W->write_bytes);
+	printf("\nMemory Write Transactions: %llu", W->write_transactions);
+	fprintf(file_results, "\nMemory Write Transactions: %llu", W->write_transactions);
+	printf("\nStores Written to Memory: %llu", W->memory_stores);
+	fprintf(file_results, "\nStores Written to Memory: %llu", W->memory_stores);
+	printf("\nWrites Coalesced: %llu", W->coalesced);
+	fprintf(file_results, "\nWrites Coalesced: %llu", W->coalesced);
+	printf("\nWrite Buffer Full Drains: %llu", W->full_drains);
+	fprintf(file_results, "\nWrite Buffer Full Drains: %llu", W->full_drains);
+}
+
+#endif